@@ -1,6 +1,7 @@
 #ifndef GIFDEC_H
 #define GIFDEC_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -23,6 +24,9 @@ typedef struct gd_GCE {
 
 typedef struct gd_GIF {
     int fd;
+    const uint8_t *data; /* set instead of fd when reading from memory */
+    size_t size;
+    off_t pos;
     off_t anim_start;
     uint16_t width, height;
     uint16_t depth;
@@ -43,6 +47,7 @@ typedef struct gd_GIF {
 } gd_GIF;
 
 gd_GIF *gd_open_gif(const char *fname);
+gd_GIF *gd_open_gif_memory(const void *data, size_t size);
 int gd_get_frame(gd_GIF *gif);
 void gd_render_frame(gd_GIF *gif, uint8_t *buffer);
 int gd_is_bgcolor(gd_GIF *gif, uint8_t color[3]);
@@ -28,19 +28,42 @@ typedef struct Table {
     Entry *entries;
 } Table;
 
+/* Reads from the file descriptor, or from memory when opened with gd_open_gif_memory. */
+static int
+gd_read(gd_GIF *gif, void *buf, size_t n)
+{
+    if (!gif->data)
+        return _read(gif->fd, buf, (unsigned) n);
+    n = gif->pos < (off_t) gif->size ? MIN(n, gif->size - (size_t) gif->pos) : 0;
+    memcpy(buf, gif->data + gif->pos, n);
+    gif->pos += n;
+    return (int) n;
+}
+
+static off_t
+gd_seek(gd_GIF *gif, off_t offset, int whence)
+{
+    if (!gif->data)
+        return _lseek(gif->fd, offset, whence);
+    if (whence == SEEK_CUR)
+        offset += gif->pos;
+    gif->pos = offset;
+    return offset;
+}
+
 static uint16_t
-read_num(int fd)
+read_num(gd_GIF *gif)
 {
     uint8_t bytes[2];
 
-    _read(fd, bytes, 2);
+    gd_read(gif, bytes, 2);
     return bytes[0] + (((uint16_t) bytes[1]) << 8);
 }
 
-gd_GIF *
-gd_open_gif(const char *fname)
+/* src only holds the input (fd or memory) to read the header from. */
+static gd_GIF *
+open_gif(gd_GIF *src)
 {
-    int fd;
     uint8_t sigver[3];
     uint16_t width, height, depth;
     uint8_t fdsz, bgidx, aspect;
@@ -49,32 +72,27 @@ gd_open_gif(const char *fname)
     int gct_sz;
     gd_GIF *gif;
 
-    fd = _open(fname, O_RDONLY);
-    if (fd == -1) return NULL;
-#ifdef _WIN32
-    _setmode(fd, O_BINARY);
-#endif
     /* Header */
-    _read(fd, sigver, 3);
+    gd_read(src, sigver, 3);
     if (memcmp(sigver, "GIF", 3) != 0) {
         fprintf(stderr, "invalid signature\n");
-        goto fail;
+        return NULL;
     }
     /* Version */
-    _read(fd, sigver, 3);
+    gd_read(src, sigver, 3);
     if (memcmp(sigver, "89a", 3) != 0) {
         fprintf(stderr, "invalid version\n");
-        goto fail;
+        return NULL;
     }
     /* Width x Height */
-    width  = read_num(fd);
-    height = read_num(fd);
+    width  = read_num(src);
+    height = read_num(src);
     /* FDSZ */
-    _read(fd, &fdsz, 1);
+    gd_read(src, &fdsz, 1);
     /* Presence of GCT */
     if (!(fdsz & 0x80)) {
         fprintf(stderr, "no global color table\n");
-        goto fail;
+        return NULL;
     }
     /* Color Space's Depth */
     depth = ((fdsz >> 4) & 7) + 1;
@@ -82,19 +100,22 @@ gd_open_gif(const char *fname)
     /* GCT Size */
     gct_sz = 1 << ((fdsz & 0x07) + 1);
     /* Background Color Index */
-    _read(fd, &bgidx, 1);
+    gd_read(src, &bgidx, 1);
     /* Aspect Ratio */
-    _read(fd, &aspect, 1);
+    gd_read(src, &aspect, 1);
     /* Create gd_GIF Structure. */
     gif = calloc(1, sizeof(*gif) + 4 * width * height);
-    if (!gif) goto fail;
-    gif->fd = fd;
+    if (!gif) return NULL;
+    gif->fd = src->fd;
+    gif->data = src->data;
+    gif->size = src->size;
+    gif->pos = src->pos;
     gif->width  = width;
     gif->height = height;
     gif->depth  = depth;
     /* Read GCT */
     gif->gct.size = gct_sz;
-    _read(fd, gif->gct.colors, 3 * gif->gct.size);
+    gd_read(gif, gif->gct.colors, 3 * gif->gct.size);
     gif->palette = &gif->gct;
     gif->bgindex = bgidx;
     gif->canvas = (uint8_t *) &gif[1];
@@ -105,22 +126,45 @@ gd_open_gif(const char *fname)
     if (bgcolor[0] || bgcolor[1] || bgcolor [2])
         for (i = 0; i < gif->width * gif->height; i++)
             memcpy(&gif->canvas[i*3], bgcolor, 3);
-    gif->anim_start = _lseek(fd, 0, SEEK_CUR);
-    goto ok;
-fail:
-    _close(fd);
-ok:
+    gif->anim_start = gd_seek(gif, 0, SEEK_CUR);
+    return gif;
+}
+
+gd_GIF *
+gd_open_gif(const char *fname)
+{
+    gd_GIF src = {0};
+    gd_GIF *gif;
+
+    src.fd = _open(fname, O_RDONLY);
+    if (src.fd == -1) return NULL;
+#ifdef _WIN32
+    _setmode(src.fd, O_BINARY);
+#endif
+    gif = open_gif(&src);
+    if (!gif) _close(src.fd);
     return gif;
 }
 
+gd_GIF *
+gd_open_gif_memory(const void *data, size_t size)
+{
+    gd_GIF src = {0};
+
+    src.fd = -1;
+    src.data = (const uint8_t *) data;
+    src.size = size;
+    return open_gif(&src);
+}
+
 static void
 discard_sub_blocks(gd_GIF *gif)
 {
     uint8_t size;
 
     do {
-        _read(gif->fd, &size, 1);
-        _lseek(gif->fd, size, SEEK_CUR);
+        gd_read(gif, &size, 1);
+        gd_seek(gif, size, SEEK_CUR);
     } while (size);
 }
 
@@ -131,21 +175,21 @@ read_plain_text_ext(gd_GIF *gif)
         uint16_t tx, ty, tw, th;
         uint8_t cw, ch, fg, bg;
         off_t sub_block;
-        _lseek(gif->fd, 1, SEEK_CUR); /* block size = 12 */
-        tx = read_num(gif->fd);
-        ty = read_num(gif->fd);
-        tw = read_num(gif->fd);
-        th = read_num(gif->fd);
-        _read(gif->fd, &cw, 1);
-        _read(gif->fd, &ch, 1);
-        _read(gif->fd, &fg, 1);
-        _read(gif->fd, &bg, 1);
-        sub_block = _lseek(gif->fd, 0, SEEK_CUR);
+        gd_seek(gif, 1, SEEK_CUR); /* block size = 12 */
+        tx = read_num(gif);
+        ty = read_num(gif);
+        tw = read_num(gif);
+        th = read_num(gif);
+        gd_read(gif, &cw, 1);
+        gd_read(gif, &ch, 1);
+        gd_read(gif, &fg, 1);
+        gd_read(gif, &bg, 1);
+        sub_block = gd_seek(gif, 0, SEEK_CUR);
         gif->plain_text(gif, tx, ty, tw, th, cw, ch, fg, bg);
-        _lseek(gif->fd, sub_block, SEEK_SET);
+        gd_seek(gif, sub_block, SEEK_SET);
     } else {
         /* Discard plain text metadata. */
-        _lseek(gif->fd, 13, SEEK_CUR);
+        gd_seek(gif, 13, SEEK_CUR);
     }
     /* Discard plain text sub-blocks. */
     discard_sub_blocks(gif);
@@ -157,24 +201,24 @@ read_graphic_control_ext(gd_GIF *gif)
     uint8_t rdit;
 
     /* Discard block size (always 0x04). */
-    _lseek(gif->fd, 1, SEEK_CUR);
-    _read(gif->fd, &rdit, 1);
+    gd_seek(gif, 1, SEEK_CUR);
+    gd_read(gif, &rdit, 1);
     gif->gce.disposal = (rdit >> 2) & 3;
     gif->gce.input = rdit & 2;
     gif->gce.transparency = rdit & 1;
-    gif->gce.delay = read_num(gif->fd);
-    _read(gif->fd, &gif->gce.tindex, 1);
+    gif->gce.delay = read_num(gif);
+    gd_read(gif, &gif->gce.tindex, 1);
     /* Skip block terminator. */
-    _lseek(gif->fd, 1, SEEK_CUR);
+    gd_seek(gif, 1, SEEK_CUR);
 }
 
 static void
 read_comment_ext(gd_GIF *gif)
 {
     if (gif->comment) {
-        off_t sub_block = _lseek(gif->fd, 0, SEEK_CUR);
+        off_t sub_block = gd_seek(gif, 0, SEEK_CUR);
         gif->comment(gif);
-        _lseek(gif->fd, sub_block, SEEK_SET);
+        gd_seek(gif, sub_block, SEEK_SET);
     }
     /* Discard comment sub-blocks. */
     discard_sub_blocks(gif);
@@ -187,21 +231,21 @@ read_application_ext(gd_GIF *gif)
     char app_auth_code[3];
 
     /* Discard block size (always 0x0B). */
-    _lseek(gif->fd, 1, SEEK_CUR);
+    gd_seek(gif, 1, SEEK_CUR);
     /* Application Identifier. */
-    _read(gif->fd, app_id, 8);
+    gd_read(gif, app_id, 8);
     /* Application Authentication Code. */
-    _read(gif->fd, app_auth_code, 3);
+    gd_read(gif, app_auth_code, 3);
     if (!strncmp(app_id, "NETSCAPE", sizeof(app_id))) {
         /* Discard block size (0x03) and constant byte (0x01). */
-        _lseek(gif->fd, 2, SEEK_CUR);
-        gif->loop_count = read_num(gif->fd);
+        gd_seek(gif, 2, SEEK_CUR);
+        gif->loop_count = read_num(gif);
         /* Skip block terminator. */
-        _lseek(gif->fd, 1, SEEK_CUR);
+        gd_seek(gif, 1, SEEK_CUR);
     } else if (gif->application) {
-        off_t sub_block = _lseek(gif->fd, 0, SEEK_CUR);
+        off_t sub_block = gd_seek(gif, 0, SEEK_CUR);
         gif->application(gif, app_id, app_auth_code);
-        _lseek(gif->fd, sub_block, SEEK_SET);
+        gd_seek(gif, sub_block, SEEK_SET);
         discard_sub_blocks(gif);
     } else {
         discard_sub_blocks(gif);
@@ -213,7 +257,7 @@ read_ext(gd_GIF *gif)
 {
     uint8_t label;
 
-    _read(gif->fd, &label, 1);
+    gd_read(gif, &label, 1);
     switch (label) {
     case 0x01:
         read_plain_text_ext(gif);
@@ -284,11 +328,11 @@ get_key(gd_GIF *gif, int key_size, uint8_t *sub_len, uint8_t *shift, uint8_t *by
         if (rpad == 0) {
             /* Update byte. */
             if (*sub_len == 0) {
-                _read(gif->fd, sub_len, 1); /* Must be nonzero! */
+                gd_read(gif, sub_len, 1); /* Must be nonzero! */
                 if (*sub_len == 0)
                     return 0x1000;
             }
-            _read(gif->fd, byte, 1);
+            gd_read(gif, byte, 1);
             (*sub_len)--;
         }
         frag_size = MIN(key_size - bits_read, 8 - rpad);
@@ -336,12 +380,12 @@ read_image_data(gd_GIF *gif, int interlace)
     Entry entry;
     off_t start, end;
 
-    _read(gif->fd, &byte, 1);
+    gd_read(gif, &byte, 1);
     key_size = (int) byte;
-    start = _lseek(gif->fd, 0, SEEK_CUR);
+    start = gd_seek(gif, 0, SEEK_CUR);
     discard_sub_blocks(gif);
-    end = _lseek(gif->fd, 0, SEEK_CUR);
-    _lseek(gif->fd, start, SEEK_SET);
+    end = gd_seek(gif, 0, SEEK_CUR);
+    gd_seek(gif, start, SEEK_SET);
     clear = 1 << key_size;
     stop = clear + 1;
     table = new_table(key_size);
@@ -392,8 +436,8 @@ read_image_data(gd_GIF *gif, int interlace)
     }
     free(table);
     if (key == stop)
-        _read(gif->fd, &sub_len, 1); /* Must be zero! */
-    _lseek(gif->fd, end, SEEK_SET);
+        gd_read(gif, &sub_len, 1); /* Must be zero! */
+    gd_seek(gif, end, SEEK_SET);
     return 0;
 }
 
@@ -406,18 +450,18 @@ read_image(gd_GIF *gif)
     int interlace;
 
     /* Image Descriptor. */
-    gif->fx = read_num(gif->fd);
-    gif->fy = read_num(gif->fd);
-    gif->fw = read_num(gif->fd);
-    gif->fh = read_num(gif->fd);
-    _read(gif->fd, &fisrz, 1);
+    gif->fx = read_num(gif);
+    gif->fy = read_num(gif);
+    gif->fw = read_num(gif);
+    gif->fh = read_num(gif);
+    gd_read(gif, &fisrz, 1);
     interlace = fisrz & 0x40;
     /* Ignore Sort Flag. */
     /* Local Color Table? */
     if (fisrz & 0x80) {
         /* Read LCT */
         gif->lct.size = 1 << ((fisrz & 0x07) + 1);
-        _read(gif->fd, gif->lct.colors, 3 * gif->lct.size);
+        gd_read(gif, gif->lct.colors, 3 * gif->lct.size);
         gif->palette = &gif->lct;
     } else
         gif->palette = &gif->gct;
@@ -472,14 +516,14 @@ gd_get_frame(gd_GIF *gif)
     char sep;
 
     dispose(gif);
-    _read(gif->fd, &sep, 1);
+    gd_read(gif, &sep, 1);
     while (sep != ',') {
         if (sep == ';')
             return 0;
         if (sep == '!')
             read_ext(gif);
         else return -1;
-        _read(gif->fd, &sep, 1);
+        gd_read(gif, &sep, 1);
     }
     if (read_image(gif) == -1)
         return -1;
@@ -502,12 +546,13 @@ gd_is_bgcolor(gd_GIF *gif, uint8_t color[3])
 void
 gd_rewind(gd_GIF *gif)
 {
-    _lseek(gif->fd, gif->anim_start, SEEK_SET);
+    gd_seek(gif, gif->anim_start, SEEK_SET);
 }
 
 void
 gd_close_gif(gd_GIF *gif)
 {
-    _close(gif->fd);
+    if (!gif->data)
+        _close(gif->fd);
     free(gif);
 }
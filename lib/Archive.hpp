@@ -0,0 +1,50 @@
+#pragma once
+
+#include <MappedFile.hpp>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace sb
+{
+    // decompresses a raw deflate stream into out, which must already have the uncompressed size
+    bool inflate(std::string_view in, char* out, std::size_t outSize);
+
+    // read-only zip archive (e.g. an .osz), indexed once from its central directory
+    // members are read straight out of the mapping; stored ones without copying
+    class Archive
+    {
+    public:
+        Archive() = default;
+        Archive(const std::filesystem::path& filepath);
+        bool IsOpen() const
+        {
+            return open;
+        }
+        // names are matched the way windows paths are: case-insensitively and with either slash
+        bool Contains(const std::string& name) const;
+        // view of a stored member, or buffer filled with a deflated one
+        bool Read(const std::string& name, std::string& buffer, std::string_view& data) const;
+        const std::vector<std::string>& GetNames() const
+        {
+            return names;
+        }
+        static std::string NormaliseName(std::string_view name);
+    private:
+        struct Entry
+        {
+            std::uint64_t localHeader;
+            std::uint64_t compressedSize;
+            std::uint64_t size;
+            std::uint16_t method;
+        };
+        MappedFile file;
+        std::unordered_map<std::string, Entry> entries;
+        std::vector<std::string> names;
+        bool open = false;
+    };
+}
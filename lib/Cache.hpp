@@ -0,0 +1,466 @@
+#pragma once
+
+#include <Components.hpp>
+#include <MappedFile.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace sb
+{
+    // bump whenever the layout below or the output of parsing/initialisation changes
+    constexpr std::uint32_t CacheVersion = 6;
+
+    // 64-bit FNV-1a
+    std::uint64_t hashBytes(std::string_view data, std::uint64_t hash = 14695981039346656037ull)
+    {
+        for (unsigned char c : data)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::uint64_t StoryboardCacheKey(std::string_view osu, std::string_view osb)
+    {
+        std::uint64_t key = hashBytes(std::string_view(reinterpret_cast<const char*>(&CacheVersion), sizeof CacheVersion));
+        key = hashBytes(osu, key);
+        key = hashBytes(std::string_view("\0", 1), key);
+        return hashBytes(osb, key);
+    }
+
+    // the cache file is a header followed by flat arrays of plain records, each 8-byte aligned,
+    // so it can be mapped and read in place without any per-field decoding
+    namespace cache
+    {
+        enum Section
+        {
+            Sprites,
+            DoubleKeyframes,
+            ColourKeyframes,
+            BoolKeyframes,
+            Offsets,
+            Samples,
+            Strings,
+            Characters,
+            Info,
+            SampleDurations,
+            Media,
+            SectionCount
+        };
+        enum TrackIndex
+        {
+            PositionX,
+            PositionY,
+            Rotation,
+            ScaleX,
+            ScaleY,
+            Colour,
+            Opacity,
+            FlipV,
+            FlipH,
+            Additive,
+            TrackCount
+        };
+        struct Array
+        {
+            std::uint64_t offset;
+            std::uint64_t count;
+        };
+        struct Header
+        {
+            char magic[4];
+            std::uint32_t version;
+            std::uint64_t key;
+            double audioDuration;
+            Array sections[SectionCount];
+        };
+        struct Track
+        {
+            std::uint32_t begin;
+            std::uint32_t count;
+            std::uint32_t repeatBegin;
+            std::uint32_t repeatSize;
+            std::uint32_t copies;
+            std::uint32_t firstOffset;
+            // copies start at offsets shared between tracks, e.g. trigger activations, if there are any
+            std::uint32_t offsetsBegin;
+            std::uint32_t offsetCount;
+            double period;
+            // keyframe times are relative to this, for tracks that share their keyframes
+            double timeOffset;
+        };
+        struct SpriteRecord
+        {
+            std::uint32_t path;
+            std::uint8_t isAnimation;
+            std::uint8_t layer;
+            std::uint8_t origin;
+            std::uint8_t loopType;
+            std::int32_t frameCount;
+            double frameDelay;
+            double x;
+            double y;
+            double activeStart;
+            double activeEnd;
+            double visibleStart;
+            double visibleEnd;
+            Track tracks[TrackCount];
+        };
+        struct SampleRecord
+        {
+            double starttime;
+            std::uint32_t path;
+            std::int32_t layer;
+            float volume;
+        };
+        struct String
+        {
+            std::uint64_t offset;
+            std::uint64_t length;
+        };
+        struct InfoRecord
+        {
+            std::uint32_t key;
+            std::uint32_t value;
+        };
+        struct SampleDuration
+        {
+            std::uint32_t path;
+            double duration;
+        };
+        struct MediaRecord
+        {
+            double starttime;
+            double offsetX;
+            double offsetY;
+            std::uint32_t path;
+            std::uint32_t exists;
+        };
+        static_assert(std::is_trivially_copyable_v<Keyframe<double>>);
+        static_assert(std::is_trivially_copyable_v<Keyframe<sb::Colour>>);
+        static_assert(std::is_trivially_copyable_v<Keyframe<bool>>);
+
+        class Writer
+        {
+        public:
+            std::uint32_t AddString(const std::string& s)
+            {
+                strings.push_back({ characters.size(), s.size() });
+                characters.insert(characters.end(), s.begin(), s.end());
+                return (std::uint32_t)strings.size() - 1;
+            }
+            template <typename T>
+            Track AddTrack(std::vector<Keyframe<T>>& pool, const sb::Track<T>& source)
+            {
+                // read through StoredAt, which gives the keyframes however the track stores them
+                Track track = { (std::uint32_t)pool.size(), (std::uint32_t)source.StoredSize(), source.GetRepeatBegin(), source.GetRepeatSize(), source.GetCopies(), source.GetFirstOffset(), 0, 0, source.GetPeriod(), source.GetTimeOffset() };
+                for (std::size_t i = 0; i < source.StoredSize(); i++) pool.push_back(source.StoredAt(i));
+                if (const std::vector<double>* shared = source.GetOffsets().get())
+                {
+                    // written once however many tracks share them
+                    auto k = offsetIndex.find(shared);
+                    if (k == offsetIndex.end())
+                    {
+                        k = offsetIndex.emplace(shared, (std::uint32_t)offsets.size()).first;
+                        offsets.insert(offsets.end(), shared->begin(), shared->end());
+                    }
+                    track.offsetsBegin = k->second;
+                    track.offsetCount = (std::uint32_t)shared->size();
+                }
+                return track;
+            }
+            void Write(std::ofstream& file, Header& header)
+            {
+                std::uint64_t offset = sizeof(Header);
+                auto place = [&](Section section, std::size_t count, std::size_t size)
+                {
+                    offset = (offset + 7) / 8 * 8;
+                    header.sections[section] = { offset, count };
+                    offset += count * size;
+                };
+                place(Sprites, sprites.size(), sizeof(SpriteRecord));
+                place(DoubleKeyframes, doubleKeyframes.size(), sizeof(Keyframe<double>));
+                place(ColourKeyframes, colourKeyframes.size(), sizeof(Keyframe<sb::Colour>));
+                place(BoolKeyframes, boolKeyframes.size(), sizeof(Keyframe<bool>));
+                place(Offsets, offsets.size(), sizeof(double));
+                place(Samples, samples.size(), sizeof(SampleRecord));
+                place(Strings, strings.size(), sizeof(String));
+                place(Characters, characters.size(), 1);
+                place(Info, info.size(), sizeof(InfoRecord));
+                place(SampleDurations, sampleDurations.size(), sizeof(SampleDuration));
+                place(Media, media.size(), sizeof(MediaRecord));
+
+                file.write(reinterpret_cast<const char*>(&header), sizeof header);
+                std::uint64_t written = sizeof header;
+                auto put = [&](Section section, const void* data, std::size_t size)
+                {
+                    static const char padding[8] = {};
+                    file.write(padding, header.sections[section].offset - written);
+                    file.write(static_cast<const char*>(data), size);
+                    written = header.sections[section].offset + size;
+                };
+                put(Sprites, sprites.data(), sprites.size() * sizeof(SpriteRecord));
+                put(DoubleKeyframes, doubleKeyframes.data(), doubleKeyframes.size() * sizeof(Keyframe<double>));
+                put(ColourKeyframes, colourKeyframes.data(), colourKeyframes.size() * sizeof(Keyframe<sb::Colour>));
+                put(BoolKeyframes, boolKeyframes.data(), boolKeyframes.size() * sizeof(Keyframe<bool>));
+                put(Offsets, offsets.data(), offsets.size() * sizeof(double));
+                put(Samples, samples.data(), samples.size() * sizeof(SampleRecord));
+                put(Strings, strings.data(), strings.size() * sizeof(String));
+                put(Characters, characters.data(), characters.size());
+                put(Info, info.data(), info.size() * sizeof(InfoRecord));
+                put(SampleDurations, sampleDurations.data(), sampleDurations.size() * sizeof(SampleDuration));
+                put(Media, media.data(), media.size() * sizeof(MediaRecord));
+            }
+            std::vector<SpriteRecord> sprites;
+            std::vector<Keyframe<double>> doubleKeyframes;
+            std::vector<Keyframe<sb::Colour>> colourKeyframes;
+            std::vector<Keyframe<bool>> boolKeyframes;
+            std::vector<double> offsets;
+            std::unordered_map<const std::vector<double>*, std::uint32_t> offsetIndex;
+            std::vector<SampleRecord> samples;
+            std::vector<String> strings;
+            std::vector<char> characters;
+            std::vector<InfoRecord> info;
+            std::vector<SampleDuration> sampleDurations;
+            std::vector<MediaRecord> media;
+        };
+
+        class Reader
+        {
+        public:
+            Reader(const std::filesystem::path& filepath, std::uint64_t key)
+                :
+                file(filepath)
+            {
+                std::string_view data = file.GetView();
+                if (data.size() < sizeof(Header)) return;
+                header = reinterpret_cast<const Header*>(data.data());
+                if (std::memcmp(header->magic, "OSBC", 4) != 0 || header->version != CacheVersion || header->key != key) return;
+                static const std::size_t sizes[SectionCount] = {
+                    sizeof(SpriteRecord), sizeof(Keyframe<double>), sizeof(Keyframe<sb::Colour>), sizeof(Keyframe<bool>), sizeof(double),
+                    sizeof(SampleRecord), sizeof(String), 1, sizeof(InfoRecord), sizeof(SampleDuration), sizeof(MediaRecord)
+                };
+                for (int i = 0; i < SectionCount; i++)
+                {
+                    const Array& array = header->sections[i];
+                    if (array.offset % 8 != 0 || array.offset > data.size() || array.count > (data.size() - array.offset) / sizes[i]) return;
+                }
+                valid = true;
+            }
+            bool IsValid() const
+            {
+                return valid;
+            }
+            template <typename T>
+            const T* Get(Section section, std::size_t& count) const
+            {
+                count = header->sections[section].count;
+                return reinterpret_cast<const T*>(file.GetView().data() + header->sections[section].offset);
+            }
+            const Header& GetHeader() const
+            {
+                return *header;
+            }
+        private:
+            MappedFile file;
+            const Header* header = nullptr;
+            bool valid = false;
+        };
+    }
+
+    bool LoadStoryboardCache(const std::filesystem::path& cacheFile, std::uint64_t key,
+        std::vector<std::shared_ptr<Sprite>>& sprites,
+        std::vector<Sample>& samples,
+        Background& background,
+        Video& video,
+        std::unordered_map<std::string, std::string>& info,
+        double& audioDuration,
+        std::unordered_map<std::string, double>& sampleDurations
+    )
+    {
+        if (!std::filesystem::exists(cacheFile)) return false;
+        cache::Reader reader(cacheFile, key);
+        if (!reader.IsValid()) return false;
+
+        std::size_t stringCount, characterCount;
+        const cache::String* strings = reader.Get<cache::String>(cache::Strings, stringCount);
+        const char* characters = reader.Get<char>(cache::Characters, characterCount);
+        for (std::size_t i = 0; i < stringCount; i++)
+            if (strings[i].offset > characterCount || strings[i].length > characterCount - strings[i].offset) return false;
+        auto string = [&](std::uint32_t index)
+        {
+            return index < stringCount ? std::string(characters + strings[index].offset, strings[index].length) : std::string();
+        };
+
+        std::size_t doubleCount, colourCount, boolCount;
+        const Keyframe<double>* doubleKeyframes = reader.Get<Keyframe<double>>(cache::DoubleKeyframes, doubleCount);
+        const Keyframe<Colour>* colourKeyframes = reader.Get<Keyframe<Colour>>(cache::ColourKeyframes, colourCount);
+        const Keyframe<bool>* boolKeyframes = reader.Get<Keyframe<bool>>(cache::BoolKeyframes, boolCount);
+        std::size_t offsetCount;
+        const double* offsets = reader.Get<double>(cache::Offsets, offsetCount);
+        std::unordered_map<std::uint32_t, std::shared_ptr<const std::vector<double>>> sharedOffsets;
+        bool tracksValid = true;
+        auto track = [&](const auto* pool, std::size_t poolSize, cache::Track track)
+        {
+            using K = std::remove_const_t<std::remove_pointer_t<decltype(pool)>>;
+            using T = decltype(K::value);
+            if (track.begin > poolSize || track.count > poolSize - track.begin
+                || track.repeatBegin > track.count || track.repeatSize > track.count - track.repeatBegin || (track.repeatSize != 0 && track.copies == 0)
+                || track.offsetsBegin > offsetCount || track.offsetCount > offsetCount - track.offsetsBegin
+                || (track.offsetCount != 0 && (std::uint64_t)track.firstOffset + track.copies > track.offsetCount))
+            {
+                tracksValid = false;
+                return Track<T>();
+            }
+            std::shared_ptr<const std::vector<double>>& shared = sharedOffsets[track.offsetsBegin];
+            if (track.offsetCount != 0 && (!shared || shared->size() != track.offsetCount))
+                shared = std::make_shared<const std::vector<double>>(offsets + track.offsetsBegin, offsets + track.offsetsBegin + track.offsetCount);
+            return Track<T>(std::vector<K>(pool + track.begin, pool + track.begin + track.count), track.repeatBegin, track.repeatSize, track.copies, track.period,
+                track.offsetCount != 0 ? shared : nullptr, track.firstOffset, track.timeOffset);
+        };
+
+        std::vector<std::shared_ptr<Sprite>> loadedSprites;
+        std::size_t spriteCount;
+        const cache::SpriteRecord* records = reader.Get<cache::SpriteRecord>(cache::Sprites, spriteCount);
+        loadedSprites.reserve(spriteCount);
+        for (std::size_t i = 0; i < spriteCount; i++)
+        {
+            const cache::SpriteRecord& record = records[i];
+            std::unique_ptr<Sprite> sprite = record.isAnimation ?
+                std::make_unique<class Animation>(static_cast<Layer>(record.layer), static_cast<Origin>(record.origin), string(record.path), std::pair<double, double>(record.x, record.y), record.frameCount, record.frameDelay, static_cast<LoopType>(record.loopType))
+                : std::make_unique<Sprite>(static_cast<Layer>(record.layer), static_cast<Origin>(record.origin), string(record.path), std::pair<double, double>(record.x, record.y));
+            SpriteKeyframes keyframes;
+            keyframes.position.first = track(doubleKeyframes, doubleCount, record.tracks[cache::PositionX]);
+            keyframes.position.second = track(doubleKeyframes, doubleCount, record.tracks[cache::PositionY]);
+            keyframes.rotation = track(doubleKeyframes, doubleCount, record.tracks[cache::Rotation]);
+            keyframes.scale.first = track(doubleKeyframes, doubleCount, record.tracks[cache::ScaleX]);
+            keyframes.scale.second = track(doubleKeyframes, doubleCount, record.tracks[cache::ScaleY]);
+            keyframes.colour = track(colourKeyframes, colourCount, record.tracks[cache::Colour]);
+            keyframes.opacity = track(doubleKeyframes, doubleCount, record.tracks[cache::Opacity]);
+            keyframes.flipV = track(boolKeyframes, boolCount, record.tracks[cache::FlipV]);
+            keyframes.flipH = track(boolKeyframes, boolCount, record.tracks[cache::FlipH]);
+            keyframes.additive = track(boolKeyframes, boolCount, record.tracks[cache::Additive]);
+            if (!tracksValid) return false;
+            sprite->Restore({ record.activeStart, record.activeEnd }, { record.visibleStart, record.visibleEnd }, std::move(keyframes));
+            loadedSprites.push_back(std::move(sprite));
+        }
+
+        std::size_t count;
+        const cache::SampleRecord* sampleRecords = reader.Get<cache::SampleRecord>(cache::Samples, count);
+        for (std::size_t i = 0; i < count; i++)
+            samples.emplace_back(sampleRecords[i].starttime, static_cast<Layer>(sampleRecords[i].layer), string(sampleRecords[i].path), sampleRecords[i].volume);
+        const cache::InfoRecord* infoRecords = reader.Get<cache::InfoRecord>(cache::Info, count);
+        for (std::size_t i = 0; i < count; i++)
+            info.insert_or_assign(string(infoRecords[i].key), string(infoRecords[i].value));
+        const cache::SampleDuration* durations = reader.Get<cache::SampleDuration>(cache::SampleDurations, count);
+        for (std::size_t i = 0; i < count; i++)
+            sampleDurations.insert_or_assign(string(durations[i].path), durations[i].duration);
+        const cache::MediaRecord* media = reader.Get<cache::MediaRecord>(cache::Media, count);
+        if (count == 2)
+        {
+            if (media[0].exists) background = Background(string(media[0].path), { media[0].offsetX, media[0].offsetY });
+            if (media[1].exists) video = Video(media[1].starttime, string(media[1].path), { media[1].offsetX, media[1].offsetY });
+        }
+        audioDuration = reader.GetHeader().audioDuration;
+        sprites = std::move(loadedSprites);
+        return true;
+    }
+
+    void SaveStoryboardCache(const std::filesystem::path& cacheFile, std::uint64_t key,
+        const std::vector<std::shared_ptr<Sprite>>& sprites,
+        const std::vector<Sample>& samples,
+        const Background& background,
+        const Video& video,
+        const std::unordered_map<std::string, std::string>& info,
+        double audioDuration,
+        const std::unordered_map<std::string, double>& sampleDurations
+    )
+    {
+        cache::Writer writer;
+        writer.sprites.reserve(sprites.size());
+        for (const std::shared_ptr<Sprite>& sprite : sprites)
+        {
+            cache::SpriteRecord record = {};
+            const class Animation* animation = dynamic_cast<const class Animation*>(sprite.get());
+            record.path = writer.AddString(sprite->GetBaseFilePath());
+            record.isAnimation = animation != nullptr;
+            record.layer = static_cast<std::uint8_t>(sprite->GetLayer());
+            record.origin = static_cast<std::uint8_t>(sprite->GetOrigin());
+            record.loopType = animation ? static_cast<std::uint8_t>(animation->GetLoopType()) : 0;
+            record.frameCount = animation ? animation->GetFrameCount() : 0;
+            record.frameDelay = animation ? animation->GetFrameDelay() : 0;
+            record.x = sprite->GetCoordinates().first;
+            record.y = sprite->GetCoordinates().second;
+            record.activeStart = sprite->GetActiveTime().first;
+            record.activeEnd = sprite->GetActiveTime().second;
+            record.visibleStart = sprite->GetVisibleTime().first;
+            record.visibleEnd = sprite->GetVisibleTime().second;
+            const SpriteKeyframes& keyframes = sprite->GetKeyframes();
+            record.tracks[cache::PositionX] = writer.AddTrack(writer.doubleKeyframes, keyframes.position.first);
+            record.tracks[cache::PositionY] = writer.AddTrack(writer.doubleKeyframes, keyframes.position.second);
+            record.tracks[cache::Rotation] = writer.AddTrack(writer.doubleKeyframes, keyframes.rotation);
+            record.tracks[cache::ScaleX] = writer.AddTrack(writer.doubleKeyframes, keyframes.scale.first);
+            record.tracks[cache::ScaleY] = writer.AddTrack(writer.doubleKeyframes, keyframes.scale.second);
+            record.tracks[cache::Colour] = writer.AddTrack(writer.colourKeyframes, keyframes.colour);
+            record.tracks[cache::Opacity] = writer.AddTrack(writer.doubleKeyframes, keyframes.opacity);
+            record.tracks[cache::FlipV] = writer.AddTrack(writer.boolKeyframes, keyframes.flipV);
+            record.tracks[cache::FlipH] = writer.AddTrack(writer.boolKeyframes, keyframes.flipH);
+            record.tracks[cache::Additive] = writer.AddTrack(writer.boolKeyframes, keyframes.additive);
+            writer.sprites.push_back(record);
+        }
+        for (const Sample& sample : samples)
+            writer.samples.push_back({ sample.starttime, writer.AddString(sample.filepath), static_cast<std::int32_t>(sample.layer), sample.volume });
+        for (const std::pair<const std::string, std::string>& e : info)
+            writer.info.push_back({ writer.AddString(e.first), writer.AddString(e.second) });
+        for (const std::pair<const std::string, double>& e : sampleDurations)
+            writer.sampleDurations.push_back({ writer.AddString(e.first), e.second });
+        writer.media.push_back({ 0, background.offset.first, background.offset.second, writer.AddString(background.filepath), background.exists });
+        writer.media.push_back({ video.starttime, video.offset.first, video.offset.second, writer.AddString(video.filepath), video.exists });
+
+        cache::Header header = {};
+        std::memcpy(header.magic, "OSBC", 4);
+        header.version = CacheVersion;
+        header.key = key;
+        header.audioDuration = audioDuration;
+
+        // written next to the final name first so an interrupted run never leaves a truncated cache behind
+        std::filesystem::path temporaryFile = cacheFile;
+        temporaryFile += ".tmp";
+        {
+            std::ofstream file(temporaryFile, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                std::cerr << "Could not write storyboard cache \"" << cacheFile.string() << "\"\n";
+                return;
+            }
+            writer.Write(file, header);
+            if (!file.good())
+            {
+                file.close();
+                removeFile(temporaryFile);
+                std::cerr << "Could not write storyboard cache \"" << cacheFile.string() << "\"\n";
+                return;
+            }
+        }
+        try
+        {
+            std::filesystem::rename(temporaryFile, cacheFile);
+        }
+        catch (std::filesystem::filesystem_error e)
+        {
+            removeFile(temporaryFile);
+            std::cerr << "Could not write storyboard cache \"" << cacheFile.string() << "\": " << e.what() << std::endl;
+        }
+    }
+}
@@ -10,6 +10,7 @@
 #include <memory>
 #include <algorithm>
 #include <optional>
+#include <cmath>
 
 namespace sb
 {
@@ -24,35 +25,54 @@ namespace sb
             endtime = 0;
             looplength = 0;
         }
-        template <typename T>
-        void AddEvent(std::unique_ptr<Event<T>> event)
+        // gathers the loop's commands from the sprite's
+        void Initialise(const EventArena& arena, std::uint32_t begin, std::uint32_t end, std::int32_t group)
         {
-            events.push_back(std::move(event));
+            if (loopcount < 1) loopcount = 1; // today i learned that loops behave like this
+            indices.clear();
+            for (std::uint32_t i = begin; i < end; i++)
+                if (arena.GetGroup(i) == group) indices.push_back(i);
+            if (indices.empty()) return;
+            looplength = arena.GetEndTime(indices.back());
+            endtime = starttime + looplength * loopcount;
         }
-        void Initialise()
+        // appends a copy of each of the loop's commands per iteration
+        // on the channels in symbolic, only the first three iterations are appended, tagged with repeat for the keyframe compiler to carry on
+        void Expand(const EventArena& arena, std::vector<EventInstance>& events, unsigned symbolic = 0, std::uint16_t repeat = 0) const
         {
-            if (loopcount < 1) loopcount = 1; // today i learned that loops behave like this
-            looplength = (*(events.end() - 1))->GetEndTime();
-            std::vector<std::unique_ptr<IEvent>> expandedEvents;
-            std::vector<std::pair<double, double>> durations;
+            events.reserve(events.size() + indices.size() * (symbolic ? std::min(loopcount, 3) : loopcount));
             for (int i = 0; i < loopcount; i++)
-            {
-                int j = 0;
-                for (std::unique_ptr<IEvent>& event : events)
+                for (std::uint32_t index : indices)
                 {
-                    if (i == 0) durations.emplace_back(std::pair<double, double>{event->GetStartTime(), event->GetEndTime()});
-                    event->SetStartTime(starttime + durations[j].first + looplength * i);
-                    event->SetEndTime(starttime + durations[j].second + looplength * i);
-                    expandedEvents.push_back(event->copy());
-                    j++;
+                    bool isSymbolic = symbolic & (1u << (int)eventChannel(arena.GetType(index)));
+                    if (isSymbolic && i >= 3) continue;
+                    EventInstance event = { index, starttime + arena.GetStartTime(index) + looplength * i, starttime + arena.GetEndTime(index) + looplength * i };
+                    if (isSymbolic)
+                    {
+                        event.repeat = repeat;
+                        event.iteration = (std::uint16_t)i;
+                    }
+                    events.push_back(event);
                 }
+        }
+        // earliest and latest whole start milliseconds, which events are sorted by, of the loop's commands on a channel over all iterations
+        bool KeyRange(const EventArena& arena, Channel channel, double& first, double& last) const
+        {
+            bool found = false;
+            for (std::uint32_t index : indices)
+            {
+                if (eventChannel(arena.GetType(index)) != channel) continue;
+                double earliest = (int)(starttime + arena.GetStartTime(index));
+                double latest = (int)(starttime + arena.GetStartTime(index) + looplength * (loopcount - 1));
+                first = found ? std::min(first, earliest) : earliest;
+                last = found ? std::max(last, latest) : latest;
+                found = true;
             }
-            events = std::move(expandedEvents);
-            endtime = starttime + looplength * loopcount;
+            return found;
         }
-        std::vector<std::unique_ptr<IEvent>>& GetEvents()
+        const std::vector<std::uint32_t>& GetIndices() const
         {
-            return events;
+            return indices;
         }
         double GetStartTime() const
         {
@@ -71,11 +91,11 @@ namespace sb
             return loopcount;
         }
     private:
-        std::vector<std::unique_ptr<IEvent>> events;
         double starttime;
         double endtime;
         double looplength;
         int loopcount;
+        std::vector<std::uint32_t> indices;
     };
 
     class Trigger
@@ -88,46 +108,45 @@ namespace sb
             endtime(endtime),
             groupNumber(groupNumber)
         {}
-        template <typename T>
-        void AddEvent(std::unique_ptr<Event<T>> event)
-        {
-            events.push_back(std::move(event));
-        }
-        void Initialise(std::vector<std::pair<double, HitSound>>& hitSounds, std::vector<std::tuple<double, double, int>>& activations, int& id)
+        // gathers the trigger's commands from the sprite's and the times it's activated at
+        void Initialise(const HitSoundIndex& hitSounds, const EventArena& arena, std::uint32_t begin, std::uint32_t end, std::int32_t group, ActivationTable& activations, int& id)
         {
             if (!HitSound::IsHitSound(triggerName)) return; // TODO: ignoring failing and passing state triggers for now
-            looplength = (*(events.end() - 1))->GetEndTime();
-            std::vector<double> activationTimes;
-            for (const std::pair<double, HitSound>& hitSound : hitSounds)
-                if (hitSound.first >= starttime && hitSound.first < endtime
-                    && hitSound.second == HitSound(triggerName))
-                {
-                    activations.push_back(std::tuple<double, double, int>(hitSound.first, hitSound.first + looplength, groupNumber));
-                    activationTimes.push_back(hitSound.first);
-                    activated = true;
-                }
-            std::vector<std::unique_ptr<IEvent>> expandedEvents;
-            if (activated)
+            indices.clear();
+            for (std::uint32_t i = begin; i < end; i++)
+                if (arena.GetGroup(i) == group) indices.push_back(i);
+            if (indices.empty()) return;
+            looplength = arena.GetEndTime(indices.back());
+            std::vector<double> times = hitSounds.Find(HitSound(triggerName), starttime, endtime);
+            for (double time : times)
+                activations.Add(time, time + looplength, groupNumber);
+            activated = !times.empty();
+            firstID = id;
+            id += (int)times.size();
+            activationTimes = std::make_shared<const std::vector<double>>(std::move(times));
+        }
+        // appends a copy of each of the trigger's commands per activation
+        // on the channels in symbolic, only the first three activations are appended, tagged with repeat for the keyframe compiler to carry on
+        void Expand(const EventArena& arena, std::vector<EventInstance>& events, unsigned symbolic = 0, std::uint16_t repeat = 0) const
+        {
+            if (!activationTimes) return;
+            for (std::size_t i = 0; i < activationTimes->size(); i++)
             {
-                for (double activationTime : activationTimes)
+                double activationTime = (*activationTimes)[i];
+                for (std::uint32_t index : indices)
                 {
-                    for (std::unique_ptr<IEvent>& event : events)
+                    bool isSymbolic = symbolic & (1u << (int)eventChannel(arena.GetType(index)));
+                    if (isSymbolic && i >= 3) continue;
+                    EventInstance event = { index, activationTime + arena.GetStartTime(index), activationTime + arena.GetEndTime(index), firstID + (int)i, groupNumber };
+                    if (isSymbolic)
                     {
-                        std::unique_ptr<IEvent> copy = event->copy();
-                        copy->SetTriggerID(id, activationTime, groupNumber);
-                        copy->SetStartTime(activationTime + copy->GetStartTime());
-                        copy->SetEndTime(activationTime + copy->GetEndTime());
-                        expandedEvents.push_back(std::move(copy));
+                        event.repeat = repeat;
+                        event.iteration = (std::uint16_t)i;
                     }
-                    id++;
+                    events.push_back(event);
                 }
-                events = std::move(expandedEvents);
             }
         }
-        std::vector<std::unique_ptr<IEvent>>& GetEvents()
-        {
-            return events;
-        }
         const std::string& GetTriggerName() const
         {
             return triggerName;
@@ -148,40 +167,181 @@ namespace sb
         {
             return activated;
         }
+        double GetLoopLength() const
+        {
+            return looplength;
+        }
+        const std::vector<std::uint32_t>& GetIndices() const
+        {
+            return indices;
+        }
+        // sorted by time
+        const std::shared_ptr<const std::vector<double>>& GetActivationTimes() const
+        {
+            return activationTimes;
+        }
     private:
-        std::vector<std::unique_ptr<IEvent>> events;
         std::string triggerName;
         double starttime;
         double endtime;
         double looplength = 0;
         int groupNumber;
         bool activated = false;
+        std::vector<std::uint32_t> indices;
+        std::shared_ptr<const std::vector<double>> activationTimes;
+        int firstID = 0;
+    };
+
+    // frame of an animation shown the given time after it became active
+    int animationFrameAt(double elapsed, int framecount, double framedelay, LoopType looptype)
+    {
+        if (elapsed < framecount * framedelay || looptype == LoopType::LoopForever)
+            return (int)std::fmod(elapsed / framedelay, (double)framecount);
+        else return framecount - 1;
+    }
+
+    // what rendering needs of an initialised sprite, baked into a record that doesn't change afterwards
+    // its images are the storyboard's textures at frames[firstFrame] up to frames[firstFrame + frameCount - 1], one for each animation frame,
+    // and its keyframes are handles into the storyboard's RenderTracks
+    struct RenderSprite
+    {
+        RenderSprite(RenderKeyframes keyframes, std::pair<double, double> activetime, Layer layer, Origin origin, std::uint32_t firstFrame, int frameCount, double frameDelay, LoopType loopType)
+            :
+            keyframes(keyframes),
+            activetime(activetime),
+            firstFrame(firstFrame),
+            frameCount(frameCount),
+            frameDelay(frameDelay),
+            layer(layer),
+            origin(origin),
+            loopType(loopType)
+        {}
+        // animation frame shown at time, which can be out of range for a malformed animation
+        int FrameAt(double time) const
+        {
+            return frameCount == 1 ? 0 : animationFrameAt(time - activetime.first, frameCount, frameDelay, loopType);
+        }
+        const RenderKeyframes keyframes;
+        const std::pair<double, double> activetime;
+        const std::uint32_t firstFrame;
+        const int frameCount;
+        const double frameDelay;
+        const Layer layer;
+        const Origin origin;
+        const LoopType loopType;
+    };
+
+    // which sprites may be drawn at a given time, without going through all of them:
+    // time is cut into buckets, each listing the sprites with a span of time they may be drawn in that overlaps it, in drawing order.
+    // buckets a quarter as long as the average span keep what a lookup goes through close to what's actually drawn,
+    // while a span is listed about five times on average, however long some of them are
+    class ActiveSpriteIndex
+    {
+    public:
+        ActiveSpriteIndex() = default;
+        // the sorted, disjoint [start, end) spans of each sprite
+        ActiveSpriteIndex(const std::vector<std::vector<std::pair<double, double>>>& spans)
+        {
+            double totalDuration = 0;
+            std::size_t count = 0;
+            for (const std::vector<std::pair<double, double>>& sprite : spans)
+                for (const std::pair<double, double>& span : sprite)
+                {
+                    if (!isIndexed(span)) continue;
+                    start = std::min(start, span.first);
+                    end = std::max(end, span.second);
+                    totalDuration += span.second - span.first;
+                    count++;
+                }
+            if (count == 0) return;
+            bucketDuration = std::max({ 1.0, totalDuration / count / 4, (end - start) / maxBuckets });
+            std::size_t buckets = (std::size_t)((end - start) / bucketDuration) + 1;
+            bucketStarts.assign(buckets + 1, 0);
+            forEachBucket(spans, [&](std::size_t sprite, std::size_t bucket) { bucketStarts[bucket + 1]++; });
+            for (std::size_t bucket = 0; bucket < buckets; bucket++)
+                bucketStarts[bucket + 1] += bucketStarts[bucket];
+            sprites.resize(bucketStarts[buckets]);
+            std::vector<std::uint32_t> filled(bucketStarts.begin(), bucketStarts.end() - 1);
+            forEachBucket(spans, [&](std::size_t sprite, std::size_t bucket) { sprites[filled[bucket]++] = (std::uint32_t)sprite; });
+        }
+        // indices of the sprites that may be drawn at time, in the order they were given, as a range
+        std::pair<const std::uint32_t*, const std::uint32_t*> At(double time) const
+        {
+            if (!(time >= start && time <= end)) return { nullptr, nullptr };
+            std::size_t bucket = bucketOf(time);
+            return { sprites.data() + bucketStarts[bucket], sprites.data() + bucketStarts[bucket + 1] };
+        }
+        std::size_t BucketCount() const
+        {
+            return bucketStarts.empty() ? 0 : bucketStarts.size() - 1;
+        }
+        // sprites listed over all buckets
+        std::size_t Size() const
+        {
+            return sprites.size();
+        }
+    private:
+        static constexpr double maxBuckets = 1 << 22;
+        // spans that are empty or unbounded are left out
+        static bool isIndexed(const std::pair<double, double>& span)
+        {
+            return std::isfinite(span.first) && std::isfinite(span.second) && span.first < span.second;
+        }
+        std::size_t bucketOf(double time) const
+        {
+            return std::min((std::size_t)((time - start) / bucketDuration), bucketStarts.size() - 2);
+        }
+        // every bucket each sprite's spans overlap, once even if several of its spans do
+        template <typename F>
+        void forEachBucket(const std::vector<std::vector<std::pair<double, double>>>& spans, F f) const
+        {
+            for (std::size_t i = 0; i < spans.size(); i++)
+            {
+                std::size_t next = 0;
+                for (const std::pair<double, double>& span : spans[i])
+                {
+                    if (!isIndexed(span)) continue;
+                    for (std::size_t bucket = std::max(next, bucketOf(span.first)); bucket <= bucketOf(span.second); bucket++)
+                        f(i, bucket);
+                    next = std::max(next, bucketOf(span.second) + 1);
+                }
+            }
+        }
+        double start = std::numeric_limits<double>::max();
+        double end = std::numeric_limits<double>::lowest();
+        double bucketDuration = 1;
+        std::vector<std::uint32_t> bucketStarts;
+        std::vector<std::uint32_t> sprites;
     };
 
     class Sprite
     {
     public:
-        Sprite(Layer layer, Origin origin, const std::string& filepath, const std::pair<double, double>& coordinates)
+        // a sprite's commands go into the arena it was parsed with, which has to be the last sprite to add to it until the next sprite is created
+        Sprite(Layer layer, Origin origin, const std::string& filepath, const std::pair<double, double>& coordinates, std::shared_ptr<EventArena> arena = nullptr)
             :
             layer(layer),
             origin(origin),
             filepath(filepath),
-            coordinates(coordinates)
-        {}
+            coordinates(coordinates),
+            arena(std::move(arena))
+        {
+            eventsBegin = eventsEnd = this->arena ? this->arena->Size() : 0;
+        }
         template <typename T>
-        void AddEvent(std::unique_ptr<Event<T>> event)
+        void AddEvent(EventType type, Easing easing, double starttime, double endtime, T startvalue, T endvalue)
         {
-            events.push_back(std::move(event));
+            addEvent(type, easing, starttime, endtime, startvalue, endvalue, 0);
         }
         template <typename T>
-        void AddEventInLoop(std::unique_ptr<Event<T>> event)
+        void AddEventInLoop(EventType type, Easing easing, double starttime, double endtime, T startvalue, T endvalue)
         {
-            (loops.end() - 1)->AddEvent(std::move(event));
+            addEvent(type, easing, starttime, endtime, startvalue, endvalue, (std::int32_t)loops.size());
         }
         template <typename T>
-        void AddEventInTrigger(std::unique_ptr<Event<T>> event)
+        void AddEventInTrigger(EventType type, Easing easing, double starttime, double endtime, T startvalue, T endvalue)
         {
-            (triggers.end() - 1)->AddEvent(std::move(event));
+            addEvent(type, easing, starttime, endtime, startvalue, endvalue, -(std::int32_t)triggers.size());
         }
         void AddLoop(Loop loop)
         {
@@ -191,51 +351,76 @@ namespace sb
         {
             triggers.push_back(std::move(trigger));
         }
-        void Initialise(std::vector<std::pair<double, HitSound>>& hitSounds)
+        bool HasHitSoundTrigger() const
+        {
+            return std::any_of(triggers.begin(), triggers.end(), [](const Trigger& trigger) {
+                return HitSound::IsHitSound(trigger.GetTriggerName());
+                });
+        }
+        void Initialise(const HitSoundIndex& hitSounds)
         {
             initialised = true;
-            for (Loop& loop : loops) loop.Initialise();
-            std::vector<std::tuple<double, double, int>> activations;
+            static const EventArena emptyArena;
+            const EventArena& arena = this->arena ? *this->arena : emptyArena;
+            std::vector<EventInstance> events;
+            for (std::uint32_t i = eventsBegin; i < eventsEnd; i++)
+                if (arena.GetGroup(i) == 0)
+                    events.push_back({ i, arena.GetStartTime(i), arena.GetEndTime(i) });
+            for (std::size_t i = 0; i < loops.size(); i++)
+                loops[i].Initialise(arena, eventsBegin, eventsEnd, (std::int32_t)i + 1);
+            ActivationTable activations;
             int id = 1;
-            for (Trigger& trigger : triggers) trigger.Initialise(hitSounds, activations, id);
-            for (Loop& loop : loops)
-                for (std::unique_ptr<IEvent>& event : loop.GetEvents())
-                    events.emplace_back(std::move(event));
-            for (Trigger& trigger : triggers)
-                if (trigger.IsActivated())
-                    for (std::unique_ptr<IEvent>& event : trigger.GetEvents())
-                        events.emplace_back(std::move(event));
-            std::stable_sort(events.begin(), events.end(), [](const std::unique_ptr<IEvent>& a, const std::unique_ptr<IEvent>& b) {
-                int aT = a->GetStartTime();
-                int bT = b->GetStartTime();
-                int aID = a->GetTriggerID();
-                int bID = b->GetTriggerID();
+            for (std::size_t i = 0; i < triggers.size(); i++)
+                triggers[i].Initialise(hitSounds, arena, eventsBegin, eventsEnd, -(std::int32_t)i - 1, activations, id);
+            activations.Link();
+            // long loops and often activated triggers are left to the keyframe compiler where they can be, which keeps one block of keyframes
+            // repeated every period or at every activation instead of unrolling them
+            // loops in sprites with activated triggers are always unrolled, as the two interleave
+            std::vector<RepeatedGroup> repeats;
+            std::size_t bodySize = events.size();
+            for (std::size_t i = 0; i < loops.size(); i++)
+            {
+                unsigned symbolic = activations.Empty() && repeats.size() < std::numeric_limits<std::uint16_t>::max() ? symbolicChannels(arena, i, events, bodySize) : 0;
+                if (symbolic) repeats.push_back({ loops[i].GetStartTime(), loops[i].GetLoopLength(), loops[i].GetLoopCount() });
+                loops[i].Expand(arena, events, symbolic, (std::uint16_t)repeats.size());
+            }
+            for (std::size_t i = 0; i < triggers.size(); i++)
+            {
+                unsigned symbolic = repeats.size() < std::numeric_limits<std::uint16_t>::max() ? symbolicChannels(arena, triggers[i], activations, events, bodySize) : 0;
+                if (symbolic) repeats.push_back({ 0, 0, (int)triggers[i].GetActivationTimes()->size(), triggers[i].GetActivationTimes() });
+                triggers[i].Expand(arena, events, symbolic, (std::uint16_t)repeats.size());
+            }
+            std::stable_sort(events.begin(), events.end(), [](const EventInstance& a, const EventInstance& b) {
+                int aT = a.starttime;
+                int bT = b.starttime;
+                int aID = a.triggerID;
+                int bID = b.triggerID;
                 return aID != 0 && bID != 0 && aID != bID ? aID < bID : aT < bT;
                 });
 
             double endTime = std::numeric_limits<double>::min();
             double startTime = std::numeric_limits<double>::max();
-            for (const std::unique_ptr<IEvent>& event : events)
+            for (const EventInstance& event : events)
             {
-                endTime = std::max(endTime, event->GetEndTime());
-                startTime = std::min(startTime, event->GetStartTime());
+                endTime = std::max(endTime, lastEndTime(event, repeats));
+                startTime = std::min(startTime, event.starttime);
             }
             activetime = std::pair<double, double>({ startTime, endTime });
 
             std::optional<double> visibleEndTime;
             std::optional<double> visibleStartTime;
             for (auto it = events.begin(); it != events.end(); it++)
-                if ((*it)->GetType() == EventType::F)
+                if (arena.GetType(it->index) == EventType::F)
                 {
-                    if (dynamic_cast<Event<double>*>((*it).get())->GetStartValue() == 0)
-                        visibleStartTime = (*it)->GetStartTime();
+                    if (arena.GetStartValue<double>(it->index) == 0)
+                        visibleStartTime = it->starttime;
                     break;
                 }
             for (auto it = events.rbegin(); it != events.rend(); it++)
-                if ((*it)->GetType() == EventType::F)
+                if (arena.GetType(it->index) == EventType::F)
                 {
-                    if (dynamic_cast<Event<double>*>((*it).get())->GetEndValue() == 0)
-                        visibleEndTime = (*it)->GetEndTime();
+                    if (arena.GetEndValue<double>(it->index) == 0)
+                        visibleEndTime = lastEndTime(*it, repeats);
                     break;
                 }
             visibletime = std::pair<double, double>({
@@ -243,38 +428,70 @@ namespace sb
                 visibleEndTime.value_or(endTime)
                 });
 
-            positionKeyframes = generateKeyframesForEvent<EventType::M, std::pair<std::vector<Keyframe<double>>, std::vector<Keyframe<double>>>>(events, coordinates, activations);
-            rotationKeyframes = generateKeyframesForEvent<EventType::R, std::vector<Keyframe<double>>>(events, coordinates, activations);
-            scaleKeyframes = generateKeyframesForEvent<EventType::S, std::pair<std::vector<Keyframe<double>>, std::vector<Keyframe<double>>>>(events, coordinates, activations);
-            colourKeyframes = generateKeyframesForEvent<EventType::C, std::vector<Keyframe<Colour>>>(events, coordinates, activations);
-            opacityKeyframes = generateKeyframesForEvent<EventType::F, std::vector<Keyframe<double>>>(events, coordinates, activations);
-            flipHKeyframes = generateKeyframesForEvent<EventType::P, std::vector<Keyframe<bool>>, ParameterType::FlipH>(events, coordinates, activations);
-            flipVKeyframes = generateKeyframesForEvent<EventType::P, std::vector<Keyframe<bool>>, ParameterType::FlipV>(events, coordinates, activations);
-            additiveKeyframes = generateKeyframesForEvent<EventType::P, std::vector<Keyframe<bool>>>(events, coordinates, activations);
+            compileKeyframes(keyframes, arena, events, coordinates, activations, repeats);
+
+            // the commands aren't needed once they're keyframes, and the arena goes away with the last of its sprites
+            this->arena.reset();
+            eventsBegin = eventsEnd = 0;
+            loops = std::vector<Loop>();
+            triggers = std::vector<Trigger>();
+        }
+        // drops keyframes that don't change how the sprite is drawn, returning how many
+        std::size_t SimplifyKeyframes()
+        {
+            return keyframes.Simplify();
+        }
+        // the sprite as rendering sees it, with its images' textures listed from frames[firstFrame] on in the order of GetFilePaths.
+        // keyframes are handles to the sprite's tracks, or to copies of them that have been linearised, interned or compacted for this rendering only;
+        // the sprite itself is left as it is, since sprites of a shared .osb are baked again and cached by every difficulty
+        virtual RenderSprite Bake(std::uint32_t firstFrame, RenderKeyframes keyframes) const
+        {
+            return RenderSprite(keyframes, activetime, layer, origin, firstFrame, 1, 0, LoopType::LoopForever);
+        }
+        // puts the sprite back into its initialised state, e.g. when loaded from the storyboard cache
+        void Restore(std::pair<double, double> activetime, std::pair<double, double> visibletime, SpriteKeyframes keyframes)
+        {
+            initialised = true;
+            this->activetime = activetime;
+            this->visibletime = visibletime;
+            this->keyframes = std::move(keyframes);
         }
         std::pair<double, double> PositionAt(double time) const
         {
-            return keyframeValueAt<double>(positionKeyframes, time);
+            return keyframeValueAt<double>(keyframes.position, time);
         }
         double RotationAt(double time) const
         {
-            return keyframeValueAt<double>(rotationKeyframes, time);
+            return keyframes.rotation.ValueAt(time);
         }
         std::pair<double, double> ScaleAt(double time) const
         {
-            return keyframeValueAt<double>(scaleKeyframes, time);
+            return keyframeValueAt<double>(keyframes.scale, time);
         }
         Colour ColourAt(double time) const
         {
-            return keyframeValueAt<Colour>(colourKeyframes, time);
+            return keyframes.colour.ValueAt(time);
         }
         double OpacityAt(double time) const
         {
-            return keyframeValueAt<double>(opacityKeyframes, time);
+            return keyframes.opacity.ValueAt(time);
         }
         bool EffectAt(double time, ParameterType effect) const
         {
-            return keyframeValueAt<bool>(effect == ParameterType::FlipV ? flipVKeyframes : effect == ParameterType::FlipH ? flipHKeyframes : additiveKeyframes, time);
+            return (effect == ParameterType::FlipV ? keyframes.flipV : effect == ParameterType::FlipH ? keyframes.flipH : keyframes.additive).ValueAt(time);
+        }
+        // every property at once, with the cursor carried over from the previous call for the same sprite, e.g. the previous frame
+        SpriteState StateAt(double time, SpriteCursor& cursor) const
+        {
+            return keyframes.StateAt(time, cursor);
+        }
+        bool IsInitialised() const
+        {
+            return initialised;
+        }
+        const SpriteKeyframes& GetKeyframes() const
+        {
+            return keyframes;
         }
         Layer GetLayer() const
         {
@@ -292,6 +509,10 @@ namespace sb
         {
             return std::vector<std::string>({ filepath });
         }
+        const std::string& GetBaseFilePath() const
+        {
+            return filepath;
+        }
         const std::pair<double, double>& GetCoordinates() const
         {
             return coordinates;
@@ -311,38 +532,131 @@ namespace sb
         std::pair<double, double> visibletime;
         const std::string filepath;
     private:
-        std::vector<std::unique_ptr<IEvent>> events;
+        // channels of a loop whose iterations past the third can be left to the keyframe compiler: those where the loop's commands fall on
+        // whole milliseconds, each iteration sorts into one unbroken run after the previous, and no other command on the channel sorts into
+        // the middle of them (ties keep the order events were added in: body events, then loops in order)
+        unsigned symbolicChannels(const EventArena& arena, std::size_t loop, const std::vector<EventInstance>& events, std::size_t bodySize) const
+        {
+            const Loop& current = loops[loop];
+            double looplength = current.GetLoopLength();
+            auto isWhole = [](double time) { return std::trunc(time) == time; };
+            if (current.GetLoopCount() < 4 || looplength <= 0 || !isWhole(current.GetStartTime()) || !isWhole(looplength)) return 0;
+            unsigned symbolic = 0;
+            for (int c = 0; c < (int)Channel::None; c++)
+            {
+                Channel channel = (Channel)c;
+                bool eligible = true;
+                std::optional<double> earliest;
+                std::optional<double> latest;
+                for (std::uint32_t index : current.GetIndices())
+                {
+                    if (eventChannel(arena.GetType(index)) != channel) continue;
+                    if (!isWhole(arena.GetStartTime(index)) || !isWhole(arena.GetEndTime(index))) eligible = false;
+                    earliest = std::min(earliest.value_or(arena.GetStartTime(index)), arena.GetStartTime(index));
+                    latest = std::max(latest.value_or(arena.GetStartTime(index)), arena.GetStartTime(index));
+                }
+                if (!eligible || !earliest.has_value() || *latest - *earliest > looplength) continue;
+                double firstKey;
+                double lastKey;
+                current.KeyRange(arena, channel, firstKey, lastKey);
+                if (isUninterrupted(arena, channel, firstKey, lastKey, events, bodySize, loop)) symbolic |= 1u << c;
+            }
+            return symbolic;
+        }
+        // same for the activations of a trigger, which also have to be whole milliseconds, sorted, the only ones in the sprite, and each
+        // over before the next starts, so that keyframe compilation never has to cut one short
+        unsigned symbolicChannels(const EventArena& arena, const Trigger& trigger, const ActivationTable& activations, const std::vector<EventInstance>& events, std::size_t bodySize) const
+        {
+            const std::shared_ptr<const std::vector<double>>& times = trigger.GetActivationTimes();
+            if (!times || times->size() < 4 || times->size() != activations.Size()) return 0;
+            auto isWhole = [](double time) { return std::trunc(time) == time; };
+            double earliest = std::numeric_limits<double>::max();
+            double latest = std::numeric_limits<double>::lowest();
+            for (std::uint32_t index : trigger.GetIndices())
+            {
+                if (!isWhole(arena.GetStartTime(index)) || !isWhole(arena.GetEndTime(index))) return 0;
+                earliest = std::min(earliest, arena.GetStartTime(index));
+                latest = std::max(latest, arena.GetStartTime(index));
+            }
+            for (std::size_t i = 0; i < times->size(); i++)
+            {
+                if (!isWhole((*times)[i])) return 0;
+                if (i > 0 && ((*times)[i - 1] + trigger.GetLoopLength() > (*times)[i] || (*times)[i - 1] + latest >= (*times)[i] + earliest)) return 0;
+            }
+            unsigned symbolic = 0;
+            for (int c = 0; c < (int)Channel::None; c++)
+            {
+                Channel channel = (Channel)c;
+                std::optional<double> first;
+                std::optional<double> last;
+                for (std::uint32_t index : trigger.GetIndices())
+                {
+                    if (eventChannel(arena.GetType(index)) != channel) continue;
+                    first = std::min(first.value_or(arena.GetStartTime(index)), arena.GetStartTime(index));
+                    last = std::max(last.value_or(arena.GetStartTime(index)), arena.GetStartTime(index));
+                }
+                if (!first.has_value()) continue;
+                if (isUninterrupted(arena, channel, times->front() + *first, times->back() + *last, events, bodySize, loops.size())) symbolic |= 1u << c;
+            }
+            return symbolic;
+        }
+        // whether no body or loop command on a channel sorts in between the first and last keys of a group of commands that was added at the
+        // given position among the loops (triggers come after them all), given that events with the same key keep the order they were added in
+        bool isUninterrupted(const EventArena& arena, Channel channel, double firstKey, double lastKey, const std::vector<EventInstance>& events, std::size_t bodySize, std::size_t position) const
+        {
+            for (std::size_t i = 0; i < bodySize; i++)
+            {
+                double key = (int)events[i].starttime;
+                if (eventChannel(arena.GetType(events[i].index)) == channel && firstKey < key && key <= lastKey) return false;
+            }
+            for (std::size_t i = 0; i < loops.size(); i++)
+            {
+                double first;
+                double last;
+                if (i == position || !loops[i].KeyRange(arena, channel, first, last)) continue;
+                bool before = i < position ? last <= firstKey : last < firstKey;
+                bool after = i < position ? first > lastKey : first >= lastKey;
+                if (!before && !after) return false;
+            }
+            return true;
+        }
+        // end time of the last copy of an event, which for the iterations of a symbolically evaluated loop or trigger is that in its last iteration
+        static double lastEndTime(const EventInstance& event, const std::vector<RepeatedGroup>& repeats)
+        {
+            if (event.repeat == 0) return event.endtime;
+            const RepeatedGroup& group = repeats[event.repeat - 1];
+            return event.endtime + group.Shift(event.iteration, group.count - 1);
+        }
+        template <typename T>
+        void addEvent(EventType type, Easing easing, double starttime, double endtime, T startvalue, T endvalue, std::int32_t group)
+        {
+            if (!arena) throw std::exception("Sprite has no event arena");
+            arena->Add(type, easing, starttime, endtime, startvalue, endvalue, group);
+            eventsEnd = arena->Size();
+        }
         bool initialised = false;
         const Layer layer;
         const Origin origin;
         const std::pair<double, double> coordinates;
-        std::pair<std::vector<Keyframe<double>>, std::vector<Keyframe<double>>> positionKeyframes;
-        std::vector<Keyframe<double>> rotationKeyframes;
-        std::pair<std::vector<Keyframe<double>>, std::vector<Keyframe<double>>> scaleKeyframes;
-        std::vector<Keyframe<Colour>> colourKeyframes;
-        std::vector<Keyframe<double>> opacityKeyframes;
-        std::vector<Keyframe<bool>> flipVKeyframes;
-        std::vector<Keyframe<bool>> flipHKeyframes;
-        std::vector<Keyframe<bool>> additiveKeyframes;
+        std::shared_ptr<EventArena> arena;
+        std::uint32_t eventsBegin;
+        std::uint32_t eventsEnd;
+        SpriteKeyframes keyframes;
     };
 
     class Animation : public Sprite
     {
     public:
-        Animation(Layer layer, Origin origin, const std::string& filepath, const std::pair<double, double>& coordinates, int framecount, double framedelay, LoopType looptype)
+        Animation(Layer layer, Origin origin, const std::string& filepath, const std::pair<double, double>& coordinates, int framecount, double framedelay, LoopType looptype, std::shared_ptr<EventArena> arena = nullptr)
             :
-            Sprite(layer, origin, filepath, coordinates),
+            Sprite(layer, origin, filepath, coordinates, std::move(arena)),
             framecount(framecount),
             framedelay(framedelay),
             looptype(looptype)
         {}
         int frameIndexAt(double time) const
         {
-            if (time - activetime.first < framecount * framedelay || looptype == LoopType::LoopForever)
-            {
-                return (int)std::fmod(((time - activetime.first) / framedelay), (double)framecount);
-            }
-            else return framecount - 1;
+            return animationFrameAt(time - activetime.first, framecount, framedelay, looptype);
         }
         const std::string GetFilePath(double time) const
         {
@@ -363,6 +677,22 @@ namespace sb
             }
             return paths;
         }
+        RenderSprite Bake(std::uint32_t firstFrame, RenderKeyframes keyframes) const
+        {
+            return RenderSprite(keyframes, activetime, GetLayer(), GetOrigin(), firstFrame, framecount, framedelay, looptype);
+        }
+        int GetFrameCount() const
+        {
+            return framecount;
+        }
+        double GetFrameDelay() const
+        {
+            return framedelay;
+        }
+        LoopType GetLoopType() const
+        {
+            return looptype;
+        }
     private:
         const int framecount;
         const double framedelay;
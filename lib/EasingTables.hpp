@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Interpolation.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+namespace sb
+{
+    // every easing sampled over [0, 1] once, and evaluated in float by interpolating linearly between the two nearest samples
+    // times outside [0, 1], which overlapping commands can produce, fall back to applyEasing.
+    // so do the easings no table between samples can follow: Step and InOutElastic jump (at 1 and 0.5), and the circ easings turn vertical
+    class EasingTables
+    {
+    public:
+        static constexpr int Resolution = 4096;
+        static constexpr int Count = (int)Easing::Step + 1;
+        static const EasingTables& Get()
+        {
+            static const EasingTables tables;
+            return tables;
+        }
+        static bool IsTabulated(Easing easing)
+        {
+            switch (easing)
+            {
+            case Easing::Step:
+            case Easing::InOutElastic:
+            case Easing::InCirc:
+            case Easing::OutCirc:
+            case Easing::InOutCirc:
+                return false;
+            default:
+                return true;
+            }
+        }
+        float operator()(Easing easing, float t) const
+        {
+            if (!(t >= 0 && t <= 1) || !IsTabulated(easing)) return (float)applyEasing(easing, t);
+            const float* table = tables[(int)easing].data();
+            float x = t * Resolution;
+            int i = std::min((int)x, Resolution - 1);
+            return table[i] + (table[i + 1] - table[i]) * (x - i);
+        }
+        // one easing for a batch of times, written so that the compiler can keep the whole batch in vector registers
+        void operator()(Easing easing, const float (&t)[8], float (&out)[8]) const
+        {
+            const float* table = tables[(int)easing].data();
+            bool inRange = IsTabulated(easing);
+            for (int j = 0; j < 8; j++) inRange &= t[j] >= 0 && t[j] <= 1;
+            if (!inRange)
+            {
+                for (int j = 0; j < 8; j++) out[j] = (*this)(easing, t[j]);
+                return;
+            }
+            for (int j = 0; j < 8; j++)
+            {
+                float x = t[j] * Resolution;
+                int i = std::min((int)x, Resolution - 1);
+                out[j] = table[i] + (table[i + 1] - table[i]) * (x - i);
+            }
+        }
+    private:
+        EasingTables()
+        {
+            for (int e = 0; e < Count; e++)
+                for (int i = 0; i <= Resolution; i++)
+                    tables[e][i] = (float)applyEasing((Easing)e, i / (double)Resolution);
+        }
+        std::array<std::array<float, Resolution + 1>, Count> tables;
+    };
+
+    // times each easing through applyEasing and through the tables in batches of 8, and reports the largest difference between them.
+    // easings that aren't tabulated go through applyEasing both times
+    void BenchmarkEasing(std::size_t evaluations = 1 << 22)
+    {
+        static const char* names[EasingTables::Count] = {
+            "None", "Out", "In", "InQuad", "OutQuad", "InOutQuad", "InCubic", "OutCubic", "InOutCubic", "InQuart", "OutQuart", "InOutQuart",
+            "InQuint", "OutQuint", "InOutQuint", "InSine", "OutSine", "InOutSine", "InExpo", "OutExpo", "InOutExpo", "InCirc", "OutCirc", "InOutCirc",
+            "InElastic", "OutElastic", "OutElasticHalf", "OutElasticQuarter", "InOutElastic", "InBack", "OutBack", "InOutBack", "InBounce",
+            "OutBounce", "InOutBounce", "Step"
+        };
+        const EasingTables& tables = EasingTables::Get();
+        evaluations -= evaluations % 8;
+        std::vector<float> times(evaluations);
+        std::mt19937 random(0);
+        std::uniform_real_distribution<float> distribution(0, 1);
+        for (float& t : times) t = distribution(random);
+        std::vector<float> results(evaluations);
+        auto nanoseconds = [&](std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / evaluations;
+        };
+        std::cout << std::left << std::setw(20) << "easing" << std::right << std::setw(14) << "reference ns" << std::setw(14) << "table ns" << std::setw(14) << "max error" << "\n";
+        for (int e = 0; e < EasingTables::Count; e++)
+        {
+            Easing easing = (Easing)e;
+            double checksum = 0;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < evaluations; i++) checksum += applyEasing(easing, times[i]);
+            double reference = nanoseconds(start);
+            start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < evaluations; i += 8)
+                tables(easing, *reinterpret_cast<const float(*)[8]>(&times[i]), *reinterpret_cast<float(*)[8]>(&results[i]));
+            double table = nanoseconds(start);
+            for (float result : results) checksum += result;
+            // the error is measured on an evenly spaced grid instead, so that it doesn't depend on where the random times fell
+            double error = 0;
+            for (std::size_t i = 0; i <= evaluations; i++)
+            {
+                float t = i / (float)evaluations;
+                error = std::max(error, std::abs(tables(easing, t) - applyEasing(easing, t)));
+            }
+            std::cout << std::left << std::setw(20) << names[e] << std::right << std::fixed << std::setprecision(2) << std::setw(14) << reference << std::setw(14) << table
+                << std::scientific << std::setw(14) << error << std::defaultfloat << "\n";
+            // keeps the timed loops from being optimised away
+            volatile double sink = checksum;
+            (void)sink;
+        }
+    }
+}
@@ -2,10 +2,24 @@
 
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <optional>
+#include <charconv>
+#include <cctype>
 
 namespace sb
 {
+    // numeric fallback for the string_view parsers below, same rules as parseEnum
+    template <typename T>
+    std::optional<T> parseEnumIndex(std::string_view s, std::size_t count)
+    {
+        while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+        int val;
+        const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), val);
+        if (ec != std::errc() || val < 0 || val >= count) return std::nullopt;
+        return static_cast<T>(val);
+    }
+
     enum class Layer
     {
         Background,
@@ -22,6 +36,24 @@ namespace sb
         {"Foreground", Layer::Foreground},
         {"Overlay", Layer::Overlay}
     };
+    std::optional<Layer> parseLayer(std::string_view s)
+    {
+        switch (s.size())
+        {
+        case 4:
+            if (s == "Fail") return Layer::Fail;
+            if (s == "Pass") return Layer::Pass;
+            break;
+        case 7:
+            if (s == "Overlay") return Layer::Overlay;
+            break;
+        case 10:
+            if (s == "Background") return Layer::Background;
+            if (s == "Foreground") return Layer::Foreground;
+            break;
+        }
+        return parseEnumIndex<Layer>(s, LayerStrings.size());
+    }
 
     enum class Origin
     {
@@ -48,6 +80,36 @@ namespace sb
         {"BottomCentre", Origin::BottomCentre},
         {"BottomRight", Origin::BottomRight}
     };
+    std::optional<Origin> parseOrigin(std::string_view s)
+    {
+        switch (s.size())
+        {
+        case 6:
+            if (s == "Centre") return Origin::Centre;
+            break;
+        case 7:
+            if (s == "TopLeft") return Origin::TopLeft;
+            break;
+        case 8:
+            if (s == "TopRight") return Origin::TopRight;
+            break;
+        case 9:
+            if (s == "TopCentre") return Origin::TopCentre;
+            break;
+        case 10:
+            if (s == "CentreLeft") return Origin::CentreLeft;
+            if (s == "BottomLeft") return Origin::BottomLeft;
+            break;
+        case 11:
+            if (s == "CentreRight") return Origin::CentreRight;
+            if (s == "BottomRight") return Origin::BottomRight;
+            break;
+        case 12:
+            if (s == "BottomCentre") return Origin::BottomCentre;
+            break;
+        }
+        return parseEnumIndex<Origin>(s, OriginStrings.size());
+    }
 
     enum class LoopType
     {
@@ -59,6 +121,12 @@ namespace sb
         {"LoopForever", LoopType::LoopForever},
         {"LoopOnce", LoopType::LoopOnce}
     };
+    std::optional<LoopType> parseLoopType(std::string_view s)
+    {
+        if (s == "LoopForever") return LoopType::LoopForever;
+        if (s == "LoopOnce") return LoopType::LoopOnce;
+        return parseEnumIndex<LoopType>(s, LoopTypeStrings.size());
+    }
 
     enum class ParameterType
     {
@@ -72,6 +140,17 @@ namespace sb
         {"V", ParameterType::FlipV},
         {"A", ParameterType::Additive}
     };
+    std::optional<ParameterType> parseParameterType(std::string_view s)
+    {
+        if (s.size() == 1)
+            switch (s[0])
+            {
+            case 'H': return ParameterType::FlipH;
+            case 'V': return ParameterType::FlipV;
+            case 'A': return ParameterType::Additive;
+            }
+        return std::nullopt;
+    }
 
     enum class EventType
     {
@@ -98,6 +177,26 @@ namespace sb
         {"C", EventType::C},
         {"P", EventType::P}
     };
+    EventType parseEventType(std::string_view s)
+    {
+        if (s.size() == 1)
+            switch (s[0])
+            {
+            case 'F': return EventType::F;
+            case 'S': return EventType::S;
+            case 'V': return EventType::V;
+            case 'R': return EventType::R;
+            case 'M': return EventType::M;
+            case 'C': return EventType::C;
+            case 'P': return EventType::P;
+            }
+        else if (s.size() == 2 && s[0] == 'M')
+        {
+            if (s[1] == 'X') return EventType::MX;
+            if (s[1] == 'Y') return EventType::MY;
+        }
+        return EventType::None;
+    }
 
     enum class Keyword
     {
@@ -120,6 +219,28 @@ namespace sb
         {"Sample", Keyword::Sample},
         {"Animation", Keyword::Animation}
     };
+    std::optional<Keyword> parseKeyword(std::string_view s)
+    {
+        switch (s.size())
+        {
+        case 5:
+            if (s == "Video") return Keyword::Video;
+            if (s == "Break") return Keyword::Break;
+            break;
+        case 6:
+            if (s == "Sprite") return Keyword::Sprite;
+            if (s == "Sample") return Keyword::Sample;
+            if (s == "Colour") return Keyword::Colour;
+            break;
+        case 9:
+            if (s == "Animation") return Keyword::Animation;
+            break;
+        case 10:
+            if (s == "Background") return Keyword::Background;
+            break;
+        }
+        return parseEnumIndex<Keyword>(s, KeywordStrings.size());
+    }
 
     template <typename T>
     std::optional<T> parseEnum(const std::unordered_map<std::string, T> S, std::string s)
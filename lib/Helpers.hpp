@@ -4,12 +4,18 @@
 
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
+#include <array>
 #include <utility>
 #include <exception>
+#include <stdexcept>
+#include <charconv>
+#include <cctype>
 #include <filesystem>
 #include <fstream>
+#include <chrono>
 
 namespace sb
 {
@@ -32,17 +38,185 @@ namespace sb
         return split;
     }
 
-    void applyVariables(std::string& line, const std::unordered_map<std::string, std::string>& variables)
+    // walks the fields of a delimited line without copying them
+    class FieldReader
     {
-        for (const std::pair<std::string, std::string>& e : variables)
-            stringReplace(line, e.first, e.second);
+    public:
+        FieldReader(std::string_view s, char delimiter)
+            :
+            rest(s),
+            delimiter(delimiter)
+        {}
+        bool Next(std::string_view& field)
+        {
+            if (done) return false;
+            std::size_t pos = rest.find(delimiter);
+            if (pos == std::string_view::npos)
+            {
+                field = rest;
+                done = true;
+            }
+            else
+            {
+                field = rest.substr(0, pos);
+                rest.remove_prefix(pos + 1);
+            }
+            return true;
+        }
+    private:
+        std::string_view rest;
+        char delimiter;
+        bool done = false;
+    };
+
+    // same splitting rules as stringSplit, but fields past N are dropped instead of allocated
+    template <std::size_t N>
+    std::size_t splitView(std::string_view s, char delimiter, std::array<std::string_view, N>& split)
+    {
+        FieldReader reader(s, delimiter);
+        std::size_t count = 0;
+        std::string_view field;
+        while (count < N && reader.Next(field))
+            split[count++] = field;
+        for (std::size_t i = count; i < N; i++)
+            split[i] = std::string_view();
+        return count;
+    }
+
+    // like std::stod/std::stoi: leading whitespace is skipped and trailing characters are ignored
+    template <typename T>
+    T parseNumber(std::string_view s)
+    {
+        while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+        if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+        T value;
+        const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+        if (ec != std::errc()) throw std::invalid_argument("invalid number \"" + std::string(s) + "\"");
+        return value;
     }
 
+    // [Variables] definitions compiled into a trie, so a line is expanded in a single left-to-right pass
+    // where names overlap, the longest one wins (e.g. $col is never expanded as $c followed by "ol")
+    class Variables
+    {
+    public:
+        void Add(const std::string& name, const std::string& value)
+        {
+            if (definitions.emplace(name, value).second) dirty = true; // TODO: Error if already exists
+        }
+        // called once a [Variables] section ends
+        void Compile()
+        {
+            if (!dirty) return;
+            dirty = false;
+            nodes.clear();
+            values.clear();
+            rootChildren.fill(-1);
+            allDollar = true;
+            for (const std::pair<const std::string, std::string>& definition : definitions)
+            {
+                const std::string& name = definition.first;
+                if (name.empty()) continue;
+                allDollar = allDollar && name[0] == '$';
+                int node = rootChildren[static_cast<unsigned char>(name[0])];
+                if (node < 0)
+                {
+                    node = rootChildren[static_cast<unsigned char>(name[0])] = (int)nodes.size();
+                    nodes.push_back({ name[0] });
+                }
+                for (std::size_t i = 1; i < name.size(); i++)
+                {
+                    int child = nodes[node].firstChild;
+                    while (child >= 0 && nodes[child].c != name[i]) child = nodes[child].nextSibling;
+                    if (child < 0)
+                    {
+                        child = (int)nodes.size();
+                        nodes.push_back({ name[i], -1, nodes[node].firstChild });
+                        nodes[node].firstChild = child;
+                    }
+                    node = child;
+                }
+                nodes[node].value = (int)values.size();
+                values.push_back(definition.second);
+            }
+        }
+        bool Empty() const
+        {
+            return values.empty();
+        }
+        // returns either the line itself, when nothing matched, or a view of the expanded buffer
+        std::string_view Apply(std::string_view line, std::string& buffer) const
+        {
+            if (values.empty()) return line;
+            std::size_t pos = allDollar ? line.find('$') : 0;
+            if (pos == std::string_view::npos) return line;
+            std::size_t copied = 0;
+            bool matched = false;
+            while (pos < line.size())
+            {
+                std::size_t length = 0;
+                int value = Match(line, pos, length);
+                if (value >= 0)
+                {
+                    if (!matched) buffer.clear();
+                    matched = true;
+                    buffer.append(line.substr(copied, pos - copied));
+                    buffer.append(values[value]);
+                    pos += length;
+                    copied = pos;
+                }
+                else pos++;
+                if (allDollar && (pos = line.find('$', pos)) == std::string_view::npos) break;
+            }
+            if (!matched) return line;
+            buffer.append(line.substr(copied));
+            return buffer;
+        }
+    private:
+        struct Node
+        {
+            char c;
+            int firstChild = -1;
+            int nextSibling = -1;
+            int value = -1;
+        };
+        // longest variable name starting at pos, or -1
+        int Match(std::string_view line, std::size_t pos, std::size_t& length) const
+        {
+            int node = rootChildren[static_cast<unsigned char>(line[pos])];
+            int value = -1;
+            for (std::size_t i = pos + 1; node >= 0; i++)
+            {
+                if (nodes[node].value >= 0)
+                {
+                    value = nodes[node].value;
+                    length = i - pos;
+                }
+                if (i == line.size()) break;
+                int child = nodes[node].firstChild;
+                while (child >= 0 && nodes[child].c != line[i]) child = nodes[child].nextSibling;
+                node = child;
+            }
+            return value;
+        }
+        std::unordered_map<std::string, std::string> definitions;
+        std::vector<Node> nodes;
+        std::vector<std::string> values;
+        std::array<int, 256> rootChildren;
+        bool allDollar = true;
+        bool dirty = false;
+    };
+
     std::string removePathQuotes(const std::string& s)
     {
         return s[0] == '"' && s[s.length() - 1] == '"' ? s.substr(1, s.length() - 2) : s;
     }
 
+    std::string removePathQuotes(std::string_view s)
+    {
+        return std::string(s.size() >= 2 && s.front() == '"' && s.back() == '"' ? s.substr(1, s.size() - 2) : s);
+    }
+
     // taken from https://stackoverflow.com/questions/478898#478960
     std::string exec(const std::string& cmd)
     {
@@ -63,6 +237,12 @@ namespace sb
         return result;
     }
 
+    // wall time since start, for the per-phase timings printed while loading
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
     double getAudioDuration(const std::string& filepath)
     {
         return std::stod(exec("ffprobe -v quiet -show_entries format=duration -of default=noprint_wrappers=1:nokey=1 \"" + filepath + "\""));
@@ -3,8 +3,11 @@
 #include <opencv2/opencv.hpp>
 
 #include <string>
+#include <string_view>
 
 namespace sb
 {
     cv::Mat readImage(const std::string&);
+    // decodes an image that's already in memory, name is only used for messages
+    cv::Mat readImage(std::string_view data, const std::string& name);
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <Enums.hpp>
 #include <cmath>
+#include <array>
+#include <algorithm>
 
 namespace sb
 {
@@ -127,6 +129,29 @@ namespace sb
         }
     }
 
+    // how far an easing goes past its endpoints over [0, 1], as a fraction of the distance between them, e.g. about 0.1 for OutBack
+    double easingOvershoot(Easing easing)
+    {
+        static const std::array<double, (int)Easing::Step + 1> overshoots = [] {
+            std::array<double, (int)Easing::Step + 1> overshoots;
+            for (int e = 0; e < (int)overshoots.size(); e++)
+            {
+                double lowest = 0;
+                double highest = 1;
+                for (int i = 0; i <= 4096; i++)
+                {
+                    double value = applyEasing((Easing)e, i / 4096.0);
+                    lowest = std::min(lowest, value);
+                    highest = std::max(highest, value);
+                }
+                // the samples can fall just short of a peak
+                overshoots[e] = std::max(highest - 1, -lowest) * 1.01;
+            }
+            return overshoots;
+        }();
+        return (int)easing >= 0 && (int)easing < (int)overshoots.size() ? overshoots[(int)easing] : 0;
+    }
+
     template <typename T>
     T InterpolateLinear(T start, T end, double t)
     {
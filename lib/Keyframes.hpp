@@ -1,11 +1,24 @@
 #pragma once
 
 #include <Interpolation.hpp>
+#include <EasingTables.hpp>
 #include <Types.hpp>
 
 #include <limits>
 #include <vector>
+#include <utility>
+#include <optional>
+#include <type_traits>
+#include <cstdint>
 #include <memory>
+#include <exception>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 namespace sb
 {
@@ -28,36 +41,660 @@ namespace sb
         double interpolationOffset;
     };
 
+    // easingTables eases through the float EasingTables instead of applyEasing, which is faster and within about 1e-6 of it
+    template <typename T>
+    T keyframeValueBetween(const Keyframe<T>& keyframe, const Keyframe<T>& endKeyframe, double time, bool easingTables = false)
+    {
+        if (keyframe.easing == Easing::Step)
+            return keyframe.value;
+        double t = (time - keyframe.interpolationOffset) / (std::max(endKeyframe.time, endKeyframe.interpolationOffset) - keyframe.interpolationOffset);
+        // easings the tables don't cover get the exact time, since rounding it to float can move it across a jump
+        t = easingTables && t >= 0 && t <= 1 && EasingTables::IsTabulated(keyframe.easing) ? EasingTables::Get()(keyframe.easing, (float)t) : applyEasing(keyframe.easing, t);
+        return InterpolateLinear(keyframe.value, endKeyframe.value, t);
+    }
+
+    template <typename T>
+    bool keyframeValuesEqual(const T& a, const T& b)
+    {
+        if constexpr (std::is_same_v<T, Colour>) return a.R == b.R && a.G == b.G && a.B == b.B;
+        else return a == b;
+    }
+
+    // equal up to the rounding of a few interpolations
+    template <typename T>
+    bool keyframeValuesClose(const T& a, const T& b)
+    {
+        auto close = [](double x, double y) { return std::abs(x - y) <= 1e-9 * std::max({ 1.0, std::abs(x), std::abs(y) }); };
+        if constexpr (std::is_same_v<T, Colour>) return close(a.R, b.R) && close(a.G, b.G) && close(a.B, b.B);
+        else if constexpr (std::is_same_v<T, double>) return close(a, b);
+        else return a == b;
+    }
+
+    // largest difference in any component
+    template <typename T>
+    double keyframeValueDistance(const T& a, const T& b)
+    {
+        if constexpr (std::is_same_v<T, Colour>) return std::max({ std::abs(a.R - b.R), std::abs(a.G - b.G), std::abs(a.B - b.B) });
+        else return std::abs((double)a - (double)b);
+    }
+
     template <typename T>
     T keyframeValueAt(const std::vector<Keyframe<T>>& keyframes, double time)
     {
-        Keyframe<T> keyframe = Keyframe<T>();
-        Keyframe<T> endKeyframe = Keyframe<T>();
-        bool found = false;
         for (int i = 0; i < keyframes.size(); i++)
-        {
             if (keyframes[i].time > time)
+                return keyframeValueBetween(keyframes[i - 1], keyframes[i], time);
+        return keyframeValueBetween(*(keyframes.end() - 1), Keyframe<T>(), time);
+    }
+
+    // keyframes in a fraction of the space, for rendering once nothing else needs to change them:
+    // times as floats relative to the first, values as floats and easings as bytes, each in an array of their own.
+    // keyframes whose interpolation starts other than at their own time are rare, so those times are kept aside and marked in the easing's top bit.
+    // unlike delta encoding this keeps every keyframe directly addressable, which binary searches and cursors rely on
+    template <typename T>
+    class CompactKeyframes
+    {
+    public:
+        CompactKeyframes(const std::vector<Keyframe<T>>& keyframes)
+        {
+            auto first = std::find_if(keyframes.begin(), keyframes.end(), [](const Keyframe<T>& keyframe) { return std::isfinite(keyframe.time); });
+            base = first == keyframes.end() ? 0 : first->time;
+            times.reserve(keyframes.size());
+            values.reserve(keyframes.size());
+            easings.reserve(keyframes.size());
+            for (const Keyframe<T>& keyframe : keyframes)
             {
-                keyframe = keyframes[i - 1];
-                endKeyframe = keyframes[i];
-                found = true;
-                break;
+                times.push_back((float)(keyframe.time - base));
+                if constexpr (std::is_same_v<T, Colour>) values.push_back({ (float)keyframe.value.R, (float)keyframe.value.G, (float)keyframe.value.B });
+                else if constexpr (std::is_same_v<T, double>) values.push_back((float)keyframe.value);
+                else values.push_back(keyframe.value);
+                std::uint8_t easing = (std::uint8_t)keyframe.easing;
+                if (!(keyframe.interpolationOffset == keyframe.time))
+                {
+                    easing |= ownInterpolationOffset;
+                    interpolationOffsets.emplace_back((std::uint32_t)(easings.size()), keyframe.interpolationOffset - base);
+                }
+                easings.push_back(easing);
             }
-            else continue;
         }
-        if (!found) keyframe = *(keyframes.end() - 1);
-        if (keyframe.easing == Easing::Step)
-            return keyframe.value;
-        double t = (time - keyframe.interpolationOffset) / (std::max(endKeyframe.time, endKeyframe.interpolationOffset) - keyframe.interpolationOffset);
-        t = applyEasing(keyframe.easing, t);
-        return InterpolateLinear(keyframe.value, endKeyframe.value, t);
-    }
+        std::size_t Size() const
+        {
+            return times.size();
+        }
+        // what the times have been made relative to, and so what the track has to add to them
+        double Base() const
+        {
+            return base;
+        }
+        double TimeAt(std::size_t index) const
+        {
+            return times[index];
+        }
+        Keyframe<T> At(std::size_t index) const
+        {
+            Keyframe<T> keyframe;
+            keyframe.time = times[index];
+            if constexpr (std::is_same_v<T, Colour>) keyframe.value = Colour(values[index][0], values[index][1], values[index][2]);
+            else keyframe.value = values[index];
+            keyframe.easing = (Easing)(easings[index] & ~ownInterpolationOffset);
+            keyframe.interpolationOffset = keyframe.time;
+            if (easings[index] & ownInterpolationOffset)
+                keyframe.interpolationOffset = std::lower_bound(interpolationOffsets.begin(), interpolationOffsets.end(), std::make_pair((std::uint32_t)index, -std::numeric_limits<double>::infinity()))->second;
+            return keyframe;
+        }
+        std::size_t Bytes() const
+        {
+            return times.size() * sizeof(float) + values.size() * sizeof(Value) + easings.size() + interpolationOffsets.size() * sizeof(std::pair<std::uint32_t, double>);
+        }
+    private:
+        using Value = std::conditional_t<std::is_same_v<T, Colour>, std::array<float, 3>, std::conditional_t<std::is_same_v<T, bool>, bool, float>>;
+        static constexpr std::uint8_t ownInterpolationOffset = 0x80;
+        double base;
+        std::vector<float> times;
+        std::vector<Value> values;
+        std::vector<std::uint8_t> easings;
+        std::vector<std::pair<std::uint32_t, double>> interpolationOffsets;
+    };
+
+    // the keyframes of one property of a sprite
+    // a block of them can repeat periodically, which is how loops that settle into a fixed pattern are kept without unrolling them:
+    // the block is stored once, followed by what comes after its last copy, and lookups map into it by index
+    // the copies can also start at a sorted list of times shared with other tracks, e.g. a trigger's activations, from offsets[firstOffset] on
+    // the keyframes themselves can be shared with other tracks through a TrackPool, with their times stored relative to timeOffset,
+    // so At and TimeAt are in those relative times while ValueAt takes the real time.
+    // once compacted, the keyframes are only kept as CompactKeyframes and can't be simplified, linearised or interned any more
+    template <typename T>
+    class TrackPool;
+    template <typename T>
+    class TrackTable;
+    template <typename T>
+    class Track
+    {
+    public:
+        Track() = default;
+        Track(std::vector<Keyframe<T>> keyframes, std::uint32_t repeatBegin = 0, std::uint32_t repeatSize = 0, std::uint32_t copies = 1, double period = 0,
+            std::shared_ptr<const std::vector<double>> offsets = nullptr, std::uint32_t firstOffset = 0, double timeOffset = 0)
+            :
+            keyframes(std::make_shared<const std::vector<Keyframe<T>>>(std::move(keyframes))),
+            repeatBegin(repeatBegin),
+            repeatSize(repeatSize),
+            copies(repeatSize == 0 ? 1 : copies),
+            period(period),
+            offsets(repeatSize == 0 ? nullptr : std::move(offsets)),
+            firstOffset(firstOffset),
+            timeOffset(timeOffset)
+        {
+            if (this->offsets && this->offsets->size() < (std::size_t)firstOffset + this->copies)
+                throw std::exception("Track has fewer offsets than copies");
+            sorted = isSorted();
+            // lookups on an unsorted track have to scan it, so it gets unrolled
+            if (!sorted && this->copies > 1)
+            {
+                std::vector<Keyframe<T>> unrolled;
+                unrolled.reserve(Size());
+                for (std::size_t i = 0; i < Size(); i++) unrolled.push_back(At(i));
+                this->keyframes = std::make_shared<const std::vector<Keyframe<T>>>(std::move(unrolled));
+                this->repeatSize = 0;
+                this->copies = 1;
+                this->offsets = nullptr;
+            }
+        }
+        T ValueAt(double time) const
+        {
+            time -= timeOffset;
+            if (!sorted) return keyframeValueAt(*keyframes, time);
+            return valueBefore(nextAfter(time), time);
+        }
+        // same, but starting from the keyframe the previous lookup through cursor ended at, so that lookups at advancing times only take a
+        // step or two; anything else falls back to a binary search. cursors are 32 bit since every thread keeps one per track per sprite
+        T ValueAt(double time, std::uint32_t& cursor, bool easingTables = false) const
+        {
+            time -= timeOffset;
+            if (!sorted) return keyframeValueAt(*keyframes, time);
+            std::size_t size = Size();
+            std::size_t next = cursor;
+            if (next > size || (next > 0 && TimeAt(next - 1) > time)) next = nextAfter(time);
+            else
+                for (int steps = 0; next < size && TimeAt(next) <= time; steps++, next++)
+                    if (steps == 8)
+                    {
+                        next = nextAfter(time);
+                        break;
+                    }
+            cursor = (std::uint32_t)next;
+            return valueBefore(next, time, easingTables);
+        }
+        // number of keyframes with every copy of the repeated block counted
+        std::size_t Size() const
+        {
+            return StoredSize() + (std::size_t)(copies - 1) * repeatSize;
+        }
+        Keyframe<T> At(std::size_t index) const
+        {
+            if (copies == 1 || index < repeatBegin + repeatSize) return StoredAt(index);
+            std::size_t offset = index - repeatBegin;
+            std::size_t copy = offset / repeatSize;
+            if (copy >= copies) return StoredAt(index - (std::size_t)(copies - 1) * repeatSize);
+            Keyframe<T> keyframe = StoredAt(repeatBegin + offset % repeatSize);
+            keyframe.time += shift(copy);
+            keyframe.interpolationOffset += shift(copy);
+            return keyframe;
+        }
+        double TimeAt(std::size_t index) const
+        {
+            if (copies == 1 || index < repeatBegin + repeatSize) return storedTimeAt(index);
+            std::size_t offset = index - repeatBegin;
+            std::size_t copy = offset / repeatSize;
+            if (copy >= copies) return storedTimeAt(index - (std::size_t)(copies - 1) * repeatSize);
+            return storedTimeAt(repeatBegin + offset % repeatSize) + shift(copy);
+        }
+        // the keyframes as stored, with the repeated block once, whichever way they're stored
+        std::size_t StoredSize() const
+        {
+            return compact ? compact->Size() : keyframes->size();
+        }
+        Keyframe<T> StoredAt(std::size_t index) const
+        {
+            return compact ? compact->At(index) : (*keyframes)[index];
+        }
+        // drops keyframes that don't change what the track evaluates to and returns how many:
+        // - a step keyframe with the same value as the step keyframe before it
+        // - a keyframe at the same time as the next, whose own segment is empty, if the segment before it either steps or would end the
+        //   same way at the next keyframe
+        // - the keyframe between two linear segments on the same line, which merge up to rounding
+        // inside the repeated block, only keyframes whose neighbours are the same in every copy are considered
+        std::size_t Simplify()
+        {
+            if (!sorted || compact) return 0;
+            const std::vector<Keyframe<T>>& keyframes = *this->keyframes;
+            std::size_t end = repeatBegin + repeatSize;
+            auto region = [&](std::size_t i) { return copies == 1 || i < repeatBegin ? 0 : i < end ? 1 : 2; };
+            auto endTime = [](const Keyframe<T>& keyframe) { return std::max(keyframe.time, keyframe.interpolationOffset); };
+            std::vector<Keyframe<T>> kept;
+            kept.reserve(keyframes.size());
+            std::size_t previous = 0;
+            std::uint32_t removedBefore = 0;
+            std::uint32_t removedInside = 0;
+            for (std::size_t i = 0; i < keyframes.size(); i++)
+            {
+                const Keyframe<T>& keyframe = keyframes[i];
+                bool removable = false;
+                bool hasNext = i + 1 < keyframes.size() && region(i + 1) == region(i);
+                if (i > 0 && region(previous) == region(i) && (hasNext || i + 1 == keyframes.size()))
+                {
+                    const Keyframe<T>& before = kept.back();
+                    if (before.easing == Easing::Step && keyframe.easing == Easing::Step && keyframeValuesEqual(before.value, keyframe.value))
+                        removable = true;
+                    else if (hasNext)
+                    {
+                        const Keyframe<T>& next = keyframes[i + 1];
+                        if (next.time == keyframe.time)
+                            removable = before.easing == Easing::Step
+                                || (keyframeValuesEqual(next.value, keyframe.value) && endTime(next) == endTime(keyframe));
+                        else if constexpr (!std::is_same_v<T, bool>)
+                            if (before.easing == Easing::None && keyframe.easing == Easing::None
+                                && std::isfinite(before.interpolationOffset) && std::isfinite(keyframe.interpolationOffset)
+                                && endTime(keyframe) != before.interpolationOffset && endTime(next) != keyframe.interpolationOffset && endTime(next) != before.interpolationOffset)
+                            {
+                                // the segment before, extended, has to pass through both ends of this keyframe's segment
+                                auto line = [&](double time) { return InterpolateLinear(before.value, keyframe.value, (time - before.interpolationOffset) / (endTime(keyframe) - before.interpolationOffset)); };
+                                removable = keyframeValuesClose(line(keyframe.interpolationOffset), keyframe.value) && keyframeValuesClose(line(endTime(next)), next.value);
+                            }
+                    }
+                }
+                if (removable)
+                {
+                    if (region(i) == 0 && copies != 1) removedBefore++;
+                    else if (region(i) == 1) removedInside++;
+                    continue;
+                }
+                kept.push_back(keyframe);
+                previous = i;
+            }
+            std::size_t removed = keyframes.size() - kept.size();
+            if (removed == 0) return 0;
+            kept.shrink_to_fit();
+            this->keyframes = std::make_shared<const std::vector<Keyframe<T>>>(std::move(kept));
+            if (copies != 1)
+            {
+                repeatBegin -= removedBefore;
+                repeatSize -= removedInside;
+            }
+            return removed;
+        }
+        // replaces every eased segment with linear ones that stay within tolerance of it and returns how many segments were replaced
+        // the linear keyframes end on a zero-length one holding the eased segment's final value, so the keyframe after keeps its own role;
+        // segments at the edges of the repeated block are left alone, as what follows them differs between copies
+        std::size_t Linearise(double tolerance)
+        {
+            if constexpr (std::is_same_v<T, bool>) return 0;
+            else
+            {
+                if (!sorted || compact || !(tolerance > 0)) return 0;
+                const std::vector<Keyframe<T>>& keyframes = *this->keyframes;
+                std::size_t end = repeatBegin + repeatSize;
+                auto region = [&](std::size_t i) { return copies == 1 || i < repeatBegin ? 0 : i < end ? 1 : 2; };
+                std::vector<Keyframe<T>> linear;
+                linear.reserve(keyframes.size());
+                std::size_t replaced = 0;
+                std::uint32_t addedBefore = 0;
+                std::uint32_t addedInside = 0;
+                for (std::size_t i = 0; i < keyframes.size(); i++)
+                {
+                    const Keyframe<T>& keyframe = keyframes[i];
+                    std::size_t size = linear.size();
+                    if (i + 1 < keyframes.size() && region(i + 1) == region(i) && keyframe.easing != Easing::Step && keyframe.easing != Easing::None
+                        && keyframe.time < keyframes[i + 1].time && std::isfinite(keyframe.time) && std::isfinite(keyframe.interpolationOffset))
+                    {
+                        const Keyframe<T>& next = keyframes[i + 1];
+                        auto eased = [&](double time) { return keyframeValueBetween(keyframe, next, time); };
+                        resample(linear, eased, keyframe.time, next.time, tolerance);
+                        linear.emplace_back(next.time, eased(next.time), Easing::Step);
+                        replaced++;
+                    }
+                    else linear.push_back(keyframe);
+                    if (region(i) == 0 && copies != 1) addedBefore += (std::uint32_t)(linear.size() - size - 1);
+                    else if (region(i) == 1) addedInside += (std::uint32_t)(linear.size() - size - 1);
+                }
+                if (replaced == 0) return 0;
+                this->keyframes = std::make_shared<const std::vector<Keyframe<T>>>(std::move(linear));
+                if (copies != 1)
+                {
+                    repeatBegin += addedBefore;
+                    repeatSize += addedInside;
+                }
+                return replaced;
+            }
+        }
+        // sorted, disjoint [start, end) spans of time over which the track is exactly zero: where a step keyframe holds zero, or where a
+        // segment interpolates from zero to zero. nothing else is taken to be zero, so the spans can leave out some of it but never too much
+        std::vector<std::pair<double, double>> ZeroSpans() const
+        {
+            std::vector<std::pair<double, double>> spans;
+            if constexpr (std::is_same_v<T, double>)
+            {
+                if (!sorted) return spans;
+                std::size_t size = Size();
+                Keyframe<T> keyframe = At(0);
+                for (std::size_t i = 0; i < size; i++)
+                {
+                    bool zero;
+                    double end;
+                    Keyframe<T> next;
+                    if (i + 1 == size)
+                    {
+                        // what follows the last keyframe is only known if it steps
+                        zero = keyframe.easing == Easing::Step && keyframe.value == 0;
+                        end = std::numeric_limits<double>::infinity();
+                    }
+                    else
+                    {
+                        next = At(i + 1);
+                        end = next.time;
+                        zero = keyframe.value == 0 && (keyframe.easing == Easing::Step
+                            || (next.value == 0 && std::isfinite(keyframe.interpolationOffset) && std::max(next.time, next.interpolationOffset) != keyframe.interpolationOffset));
+                    }
+                    if (zero && keyframe.time < end)
+                    {
+                        double from = keyframe.time + timeOffset;
+                        double to = end + timeOffset;
+                        if (!spans.empty() && spans.back().second >= from) spans.back().second = std::max(spans.back().second, to);
+                        else spans.emplace_back(from, to);
+                    }
+                    keyframe = next;
+                }
+            }
+            return spans;
+        }
+        // empty once the track is compacted, see StoredAt
+        const std::vector<Keyframe<T>>& GetKeyframes() const
+        {
+            return *keyframes;
+        }
+        std::uint32_t GetRepeatBegin() const
+        {
+            return repeatBegin;
+        }
+        std::uint32_t GetRepeatSize() const
+        {
+            return repeatSize;
+        }
+        std::uint32_t GetCopies() const
+        {
+            return copies;
+        }
+        double GetPeriod() const
+        {
+            return period;
+        }
+        const std::shared_ptr<const std::vector<double>>& GetOffsets() const
+        {
+            return offsets;
+        }
+        std::uint32_t GetFirstOffset() const
+        {
+            return firstOffset;
+        }
+        double GetTimeOffset() const
+        {
+            return timeOffset;
+        }
+    private:
+        friend class TrackPool<T>;
+        friend class TrackTable<T>;
+        // appends linear keyframes from start up to but not including end, halving each piece until none of a few points along it is
+        // further than three quarters of tolerance from the eased curve, which leaves room for what falls between them.
+        // pieces stop getting shorter at a 64th of a millisecond, where steep easings such as the circular ones might still be off
+        template <typename Eased>
+        static void resample(std::vector<Keyframe<T>>& linear, const Eased& eased, double start, double end, double tolerance)
+        {
+            constexpr int samples = 8;
+            constexpr double shortest = 1.0 / 64;
+            T startValue = eased(start);
+            T endValue = eased(end);
+            bool within = true;
+            for (int i = 1; i < samples && within && end - start > shortest; i++)
+            {
+                double t = i / (double)samples;
+                within = keyframeValueDistance(InterpolateLinear(startValue, endValue, t), eased(start + (end - start) * t)) <= tolerance * 0.75;
+            }
+            if (within)
+            {
+                linear.emplace_back(start, startValue, Easing::None);
+                return;
+            }
+            double middle = start + (end - start) / 2;
+            resample(linear, eased, start, middle, tolerance);
+            resample(linear, eased, middle, end, tolerance);
+        }
+        // first keyframe after time, as the scan in keyframeValueAt would find it
+        std::size_t nextAfter(double time) const
+        {
+            std::size_t low = 0;
+            std::size_t high = Size();
+            while (low < high)
+            {
+                std::size_t middle = low + (high - low) / 2;
+                if (TimeAt(middle) > time) high = middle;
+                else low = middle + 1;
+            }
+            return low;
+        }
+        T valueBefore(std::size_t next, double time, bool easingTables = false) const
+        {
+            if (next == Size()) return keyframeValueBetween(StoredAt(StoredSize() - 1), Keyframe<T>(), time, easingTables);
+            return keyframeValueBetween(At(next - 1), At(next), time, easingTables);
+        }
+        double storedTimeAt(std::size_t index) const
+        {
+            return compact ? compact->TimeAt(index) : (*keyframes)[index].time;
+        }
+        // how far the given copy of the block is from the first
+        double shift(std::size_t copy) const
+        {
+            return offsets ? (*offsets)[firstOffset + copy] - (*offsets)[firstOffset] : period * copy;
+        }
+        bool isSorted() const
+        {
+            const std::vector<Keyframe<T>>& keyframes = *this->keyframes;
+            std::size_t end = repeatBegin + repeatSize;
+            for (std::size_t i = 1; i < keyframes.size(); i++)
+            {
+                double previous = keyframes[i - 1].time;
+                // the last copy of the block comes right before what follows it
+                if (i == end) previous += shift(copies - 1);
+                if (keyframes[i].time < previous) return false;
+            }
+            // each copy has to end before the next starts
+            for (std::size_t copy = 1; copy < copies; copy++)
+            {
+                if (keyframes[end - 1].time + shift(copy - 1) > keyframes[repeatBegin].time + shift(copy)) return false;
+                if (!offsets) break;
+            }
+            return true;
+        }
+        // the empty keyframes every default constructed track starts out with
+        static const std::shared_ptr<const std::vector<Keyframe<T>>>& noKeyframes()
+        {
+            static const std::shared_ptr<const std::vector<Keyframe<T>>> empty = std::make_shared<const std::vector<Keyframe<T>>>();
+            return empty;
+        }
+        std::shared_ptr<const std::vector<Keyframe<T>>> keyframes = noKeyframes();
+        std::shared_ptr<const CompactKeyframes<T>> compact;
+        std::uint32_t repeatBegin = 0;
+        std::uint32_t repeatSize = 0;
+        std::uint32_t copies = 1;
+        bool sorted = true;
+        double period = 0;
+        std::shared_ptr<const std::vector<double>> offsets;
+        std::uint32_t firstOffset = 0;
+        double timeOffset = 0;
+    };
+
+    // keeps one copy of each distinct list of keyframes, so that tracks with the same keyframes, e.g. those of a particle effect's sprites, share it
+    // with shiftTimes, keyframes that are the same up to a shift in time are shared as well, the shift going into each track's time offset.
+    // a track is only shifted if that's exact for all of its times, so lookups only differ by the rounding of the looked up time
+    template <typename T>
+    class TrackPool
+    {
+    public:
+        TrackPool(bool shiftTimes = true)
+            :
+            shiftTimes(shiftTimes)
+        {}
+        // points the track at the pool's copy of its keyframes, adding them to the pool if they're new
+        void Intern(Track<T>& track)
+        {
+            if (track.compact) return;
+            const std::vector<Keyframe<T>>& keyframes = *track.keyframes;
+            double shift = shiftTimes ? timeShift(keyframes) : 0;
+            std::uint64_t key = 14695981039346656037ull;
+            for (const Keyframe<T>& keyframe : keyframes)
+            {
+                mix(key, keyframe.time - shift);
+                mix(key, keyframe.interpolationOffset - shift);
+                mix(key, (double)keyframe.easing);
+                if constexpr (std::is_same_v<T, Colour>)
+                {
+                    mix(key, keyframe.value.R);
+                    mix(key, keyframe.value.G);
+                    mix(key, keyframe.value.B);
+                }
+                else mix(key, (double)keyframe.value);
+            }
+            tracks++;
+            totalKeyframes += keyframes.size();
+            std::vector<std::shared_ptr<const std::vector<Keyframe<T>>>>& candidates = pool[key];
+            for (const std::shared_ptr<const std::vector<Keyframe<T>>>& candidate : candidates)
+                if (equal(*candidate, keyframes, shift))
+                {
+                    track.keyframes = candidate;
+                    track.timeOffset += shift;
+                    return;
+                }
+            if (shift != 0)
+            {
+                std::vector<Keyframe<T>> shifted = keyframes;
+                for (Keyframe<T>& keyframe : shifted)
+                {
+                    keyframe.time -= shift;
+                    keyframe.interpolationOffset -= shift;
+                }
+                track.keyframes = std::make_shared<const std::vector<Keyframe<T>>>(std::move(shifted));
+                track.timeOffset += shift;
+            }
+            candidates.push_back(track.keyframes);
+            uniqueTracks++;
+            uniqueKeyframes += keyframes.size();
+        }
+        // moves the track's keyframes into compact storage, which tracks that share them through this pool then share as well
+        // this rounds times and values to floats. times are off by at most half a float ulp of the time since the track's first keyframe,
+        // which grows with the track: about 31 microseconds ten minutes in, still far below a frame. values within 1000 pixels are off by at most a 30000th of a pixel
+        void Compact(Track<T>& track)
+        {
+            if (track.compact || !track.sorted) return;
+            std::pair<std::shared_ptr<const std::vector<Keyframe<T>>>, std::shared_ptr<const CompactKeyframes<T>>>& entry = compacted[track.keyframes.get()];
+            if (!entry.second)
+            {
+                // holding on to the keyframes keeps another list from being allocated at the same address while the pool is around
+                entry.first = track.keyframes;
+                entry.second = std::make_shared<const CompactKeyframes<T>>(*track.keyframes);
+                bytes += track.keyframes->size() * sizeof(Keyframe<T>);
+                compactBytes += entry.second->Bytes();
+            }
+            track.compact = entry.second;
+            track.timeOffset += entry.second->Base();
+            track.keyframes = Track<T>::noKeyframes();
+        }
+        // bytes of the distinct keyframe lists compacted so far, before and after
+        std::size_t Bytes() const
+        {
+            return bytes;
+        }
+        std::size_t CompactBytes() const
+        {
+            return compactBytes;
+        }
+        // tracks interned so far, and how many distinct keyframe lists they came down to
+        std::size_t TrackCount() const
+        {
+            return tracks;
+        }
+        std::size_t UniqueTrackCount() const
+        {
+            return uniqueTracks;
+        }
+        // keyframes of every interned track, and those the pool actually keeps
+        std::size_t KeyframeCount() const
+        {
+            return totalKeyframes;
+        }
+        std::size_t UniqueKeyframeCount() const
+        {
+            return uniqueKeyframes;
+        }
+    private:
+        static std::uint64_t bits(double x)
+        {
+            std::uint64_t b;
+            std::memcpy(&b, &x, sizeof b);
+            return b;
+        }
+        static void mix(std::uint64_t& hash, double x)
+        {
+            hash ^= bits(x);
+            hash *= 1099511628211ull;
+            hash ^= hash >> 29;
+        }
+        // the time of the first keyframe that has one, if every time can be moved by it and back without rounding
+        static double timeShift(const std::vector<Keyframe<T>>& keyframes)
+        {
+            auto first = std::find_if(keyframes.begin(), keyframes.end(), [](const Keyframe<T>& keyframe) { return std::isfinite(keyframe.time); });
+            if (first == keyframes.end()) return 0;
+            double shift = first->time;
+            auto exact = [&](double time) { return !std::isfinite(time) || (time - shift) + shift == time; };
+            for (const Keyframe<T>& keyframe : keyframes)
+                if (!exact(keyframe.time) || !exact(keyframe.interpolationOffset)) return 0;
+            return shift;
+        }
+        // whether keyframes moved back by shift are pooled, bit for bit
+        static bool equal(const std::vector<Keyframe<T>>& pooled, const std::vector<Keyframe<T>>& keyframes, double shift)
+        {
+            if (pooled.size() != keyframes.size()) return false;
+            for (std::size_t i = 0; i < pooled.size(); i++)
+            {
+                const Keyframe<T>& a = pooled[i];
+                const Keyframe<T>& b = keyframes[i];
+                if (bits(a.time) != bits(b.time - shift) || bits(a.interpolationOffset) != bits(b.interpolationOffset - shift) || a.easing != b.easing)
+                    return false;
+                if constexpr (std::is_same_v<T, Colour>)
+                {
+                    if (bits(a.value.R) != bits(b.value.R) || bits(a.value.G) != bits(b.value.G) || bits(a.value.B) != bits(b.value.B)) return false;
+                }
+                else if constexpr (std::is_same_v<T, double>)
+                {
+                    if (bits(a.value) != bits(b.value)) return false;
+                }
+                else if (a.value != b.value) return false;
+            }
+            return true;
+        }
+        bool shiftTimes;
+        std::unordered_map<std::uint64_t, std::vector<std::shared_ptr<const std::vector<Keyframe<T>>>>> pool;
+        std::size_t tracks = 0;
+        std::size_t uniqueTracks = 0;
+        std::size_t totalKeyframes = 0;
+        std::size_t uniqueKeyframes = 0;
+        std::unordered_map<const std::vector<Keyframe<T>>*, std::pair<std::shared_ptr<const std::vector<Keyframe<T>>>, std::shared_ptr<const CompactKeyframes<T>>>> compacted;
+        std::size_t bytes = 0;
+        std::size_t compactBytes = 0;
+    };
 
     template <class T>
-    std::pair<T, T> keyframeValueAt(const std::pair<std::vector<Keyframe<T>>, std::vector<Keyframe<T>>>& keyframes, double time)
+    std::pair<T, T> keyframeValueAt(const std::pair<Track<T>, Track<T>>& tracks, double time)
     {
-        T first = keyframeValueAt<T>(keyframes.first, time);
-        T second = keyframeValueAt<T>(keyframes.second, time);
+        T first = tracks.first.ValueAt(time);
+        T second = tracks.second.ValueAt(time);
         return std::pair<T, T>(first, second);
     }
     template <typename T, typename V, typename Selector>
@@ -72,59 +709,97 @@ namespace sb
         keyframes.push_back(Keyframe<T>(time, alt, Easing::Step, interpolationOffset));
     }
 
-    template <typename T, typename V, typename Selector>
-    void generateKeyframes(std::vector<Keyframe<T>>& keyframes, const std::vector<std::unique_ptr<Event<V>>>& events, const std::vector<std::tuple<double, double, int>>& activations, Selector W)
+    // the activations of a sprite's triggers in the order their IDs were handed out, so a trigger command's own is at triggerID - 1
+    // once linked, each knows when the activation after it overrides its commands, which is all keyframe compilation needs of them
+    class ActivationTable
     {
-        for (typename std::vector<std::unique_ptr<Event<V>>>::const_iterator it = events.begin(); it < events.end(); it++)
+    public:
+        void Add(double starttime, double endtime, int groupNumber)
+        {
+            activations.push_back({ starttime, endtime, groupNumber, std::numeric_limits<double>::infinity() });
+        }
+        // an activation is resolved by its start time, to the first activation that starts then and isn't the last of all,
+        // and is cut short where the one after that starts if the two overlap
+        void Link()
         {
-            const std::unique_ptr<Event<V>>& event = *it;
-            bool appendEndtime = event->GetEndTime() > event->GetStartTime();
-            if (it == events.begin())
+            std::unordered_map<double, std::size_t> firstStarting;
+            for (std::size_t i = 0; i + 1 < activations.size(); i++)
+                firstStarting.emplace(activations[i].starttime, i);
+            for (Activation& activation : activations)
             {
-                // the starting event overrides the sprite's initial position
-                addKeyframe(W, keyframes, -std::numeric_limits<double>::infinity(), event->GetStartValue(), true, Easing::Step);
-                addKeyframe(W, keyframes, event->GetStartTime(), appendEndtime ? event->GetStartValue() : event->GetEndValue(), true, appendEndtime ? event->GetEasing() : Easing::Step);
-                if (appendEndtime)
-                    addKeyframe(W, keyframes, event->GetEndTime(), event->GetEndValue(), false, Easing::Step);
-                continue;
+                auto k = firstStarting.find(activation.starttime);
+                if (k == firstStarting.end()) continue;
+                const Activation& resolved = activations[k->second];
+                const Activation& next = activations[k->second + 1];
+                if (resolved.endtime > next.starttime) activation.overriddenAt = next.starttime;
             }
-            std::tuple<double, double, int> currActivation;
-            std::tuple<double, double, int> nextActivation;
-            bool triggersOverlap = false;
-            bool eventsOverlap = keyframes[keyframes.size() - 1].time > event->GetStartTime();
-            if (activations.size() > 0)
-                for (std::vector<std::tuple<double, double, int>>::const_iterator activationIt = activations.begin(); activationIt + 1 < activations.end(); activationIt++)
-                    if (std::get<0>(*activationIt) == event->GetTriggerST())
-                    {
-                        currActivation = *activationIt;
-                        nextActivation = *(activationIt + 1);
-                        break;
-                    }
-            if (event->GetTriggerID() != 0 && std::get<1>(currActivation) > std::get<0>(nextActivation))
-                triggersOverlap = true;
-            double starttime = triggersOverlap && event->GetEndTime() > std::get<0>(nextActivation) ?
-                std::get<0>(nextActivation)
-                : (eventsOverlap ?
-                    keyframes[keyframes.size() - 1].time
-                    : event->GetStartTime());
-            double endtime = triggersOverlap && event->GetEndTime() > std::get<0>(nextActivation) ?
-                std::get<0>(nextActivation)
-                : event->GetEndTime();
-            // the first event overrides subsequent overlapping events, but their interpolation still starts from their respective times
-            // if two trigger activations overlap, the latter overrides the former. events within triggers still override like before
-            // this also means non-trigger events before a trigger override the trigger
-            // TODO: implement trigger group numbers correctly
-            // TODO: check other miscellaneous edge cases
-            addKeyframe(W, keyframes,
-                starttime,
-                appendEndtime ? event->GetStartValue() : event->GetEndValue(), true,
-                appendEndtime ? event->GetEasing() : Easing::Step,
-                event->GetStartTime()
-            );
-            if (eventsOverlap) keyframes[keyframes.size() - 2].time = event->GetStartTime();
+        }
+        // time from which the commands of an activation are overridden by the next, infinity if they never are
+        double OverriddenAt(int triggerID) const
+        {
+            return activations[triggerID - 1].overriddenAt;
+        }
+        std::size_t Size() const
+        {
+            return activations.size();
+        }
+        bool Empty() const
+        {
+            return activations.empty();
+        }
+    private:
+        struct Activation
+        {
+            double starttime;
+            double endtime;
+            int groupNumber;
+            double overriddenAt;
+        };
+        std::vector<Activation> activations;
+    };
+
+    // appends the keyframes of the next event of a track, with the track's events visited in sorted order
+    template <typename T, typename V, typename Selector>
+    void addEventKeyframes(std::vector<Keyframe<T>>& keyframes, const EventArena& arena, const EventInstance& event, const ActivationTable& activations, Selector W)
+    {
+        const V& startValue = arena.GetStartValue<V>(event.index);
+        const V& endValue = arena.GetEndValue<V>(event.index);
+        Easing easing = arena.GetEasing(event.index);
+        bool appendEndtime = event.endtime > event.starttime;
+        if (keyframes.empty())
+        {
+            // the starting event overrides the sprite's initial position
+            addKeyframe(W, keyframes, -std::numeric_limits<double>::infinity(), startValue, true, Easing::Step);
+            addKeyframe(W, keyframes, event.starttime, appendEndtime ? startValue : endValue, true, appendEndtime ? easing : Easing::Step);
             if (appendEndtime)
-                addKeyframe(W, keyframes, endtime, event->GetEndValue(), false, Easing::Step, event->GetEndTime());
+                addKeyframe(W, keyframes, event.endtime, endValue, false, Easing::Step);
+            return;
         }
+        bool eventsOverlap = keyframes[keyframes.size() - 1].time > event.starttime;
+        double overriddenAt = event.triggerID != 0 ? activations.OverriddenAt(event.triggerID) : std::numeric_limits<double>::infinity();
+        bool overridden = event.endtime > overriddenAt;
+        double starttime = overridden ?
+            overriddenAt
+            : (eventsOverlap ?
+                keyframes[keyframes.size() - 1].time
+                : event.starttime);
+        double endtime = overridden ?
+            overriddenAt
+            : event.endtime;
+        // the first event overrides subsequent overlapping events, but their interpolation still starts from their respective times
+        // if two trigger activations overlap, the latter overrides the former. events within triggers still override like before
+        // this also means non-trigger events before a trigger override the trigger
+        // TODO: implement trigger group numbers correctly
+        // TODO: check other miscellaneous edge cases
+        addKeyframe(W, keyframes,
+            starttime,
+            appendEndtime ? startValue : endValue, true,
+            appendEndtime ? easing : Easing::Step,
+            event.starttime
+        );
+        if (eventsOverlap) keyframes[keyframes.size() - 2].time = event.starttime;
+        if (appendEndtime)
+            addKeyframe(W, keyframes, endtime, endValue, false, Easing::Step, event.endtime);
     }
 
     // a little bit of dumb bullshit down below
@@ -133,158 +808,553 @@ namespace sb
     {
         T operator()(T in) { return in; }
     };
-    constexpr bool alwaysFalse = false;
-    template <EventType T, typename R, ParameterType P = ParameterType::Additive>
-    R generateKeyframesForEvent(const std::vector<std::unique_ptr<IEvent>>& events, std::pair<double, double> coordinates, const std::vector<std::tuple<double, double, int>>& activations)
+    struct first
     {
-        static_assert(T != EventType::P && P == ParameterType::Additive || T == EventType::P, "Invalid template arguments");
-        auto XKeyframes = std::vector<Keyframe<double>>();
-        auto YKeyframes = std::vector<Keyframe<double>>();
-        R keyframes = R();
-        auto applicableEvents = std::vector<std::unique_ptr<IEvent>>();
-        struct isApplicable
-        {
-            bool operator()(const std::unique_ptr<IEvent>& event)
-            {
-                EventType type = event->GetType();
-                if constexpr (T == EventType::M) return type == EventType::M || type == EventType::MX || type == EventType::MY;
-                else if constexpr (T == EventType::R) return type == EventType::R;
-                else if constexpr (T == EventType::S) return type == EventType::S || type == EventType::V;
-                else if constexpr (T == EventType::C) return type == EventType::C;
-                else if constexpr (T == EventType::F) return type == EventType::F;
-                else if constexpr (T == EventType::P && P == ParameterType::Additive) return type == EventType::P && dynamic_cast<Event<ParameterType>*>(event.get())->GetStartValue() == ParameterType::Additive;
-                else if constexpr (T == EventType::P && P == ParameterType::FlipH) return type == EventType::P && dynamic_cast<Event<ParameterType>*>(event.get())->GetStartValue() == ParameterType::FlipH;
-                else if constexpr (T == EventType::P && P == ParameterType::FlipV) return type == EventType::P && dynamic_cast<Event<ParameterType>*>(event.get())->GetStartValue() == ParameterType::FlipV;
-                //else static_assert(alwaysFalse, "Template argument T invalid");
-            }
-        };
-        isApplicable isApplicable;
-        for (const std::unique_ptr<IEvent>& event : events)
-            if (isApplicable(event))
-                applicableEvents.push_back(event->copy());
-        if (applicableEvents.size() == 0)
+        double operator()(std::pair<double, double> in) { return in.first; }
+    };
+    struct second
+    {
+        double operator()(std::pair<double, double> in) { return in.second; }
+    };
+
+    // where the last lookup into each of a sprite's tracks ended up
+    struct SpriteCursor
+    {
+        std::pair<std::uint32_t, std::uint32_t> position;
+        std::uint32_t rotation = 0;
+        std::pair<std::uint32_t, std::uint32_t> scale;
+        std::uint32_t colour = 0;
+        std::uint32_t opacity = 0;
+        std::uint32_t flipV = 0;
+        std::uint32_t flipH = 0;
+        std::uint32_t additive = 0;
+    };
+
+    // every property of a sprite at one point in time
+    struct SpriteState
+    {
+        std::pair<double, double> position;
+        double rotation;
+        std::pair<double, double> scale;
+        Colour colour;
+        double opacity;
+        bool flipV;
+        bool flipH;
+        bool additive;
+    };
+
+    // how far linearised tracks may stray from the eased ones, in the units of each track
+    struct LinearisationTolerance
+    {
+        double position;
+        double rotation;
+        double scale;
+        double colour;
+        double opacity;
+    };
+
+    // the pools the tracks of a storyboard's sprites are interned in, one for each type of value
+    struct SpriteTrackPools
+    {
+        TrackPool<double> doubles;
+        TrackPool<Colour> colours;
+        TrackPool<bool> bools;
+        std::size_t TrackCount() const
         {
-            if constexpr (T == EventType::M)
-            {
-                XKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), coordinates.first, Easing::Step, -std::numeric_limits<double>::infinity()));
-                YKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), coordinates.second, Easing::Step, -std::numeric_limits<double>::infinity()));
-                return std::pair<std::vector<Keyframe<double>>, std::vector<Keyframe<double>>>(XKeyframes, YKeyframes);
-            }
-            else if constexpr (T == EventType::R)
+            return doubles.TrackCount() + colours.TrackCount() + bools.TrackCount();
+        }
+        std::size_t UniqueTrackCount() const
+        {
+            return doubles.UniqueTrackCount() + colours.UniqueTrackCount() + bools.UniqueTrackCount();
+        }
+        std::size_t KeyframeCount() const
+        {
+            return doubles.KeyframeCount() + colours.KeyframeCount() + bools.KeyframeCount();
+        }
+        std::size_t UniqueKeyframeCount() const
+        {
+            return doubles.UniqueKeyframeCount() + colours.UniqueKeyframeCount() + bools.UniqueKeyframeCount();
+        }
+        std::size_t Bytes() const
+        {
+            return doubles.Bytes() + colours.Bytes() + bools.Bytes();
+        }
+        std::size_t CompactBytes() const
+        {
+            return doubles.CompactBytes() + colours.CompactBytes() + bools.CompactBytes();
+        }
+    };
+
+    struct SpriteKeyframes
+    {
+        std::pair<Track<double>, Track<double>> position;
+        Track<double> rotation;
+        std::pair<Track<double>, Track<double>> scale;
+        Track<Colour> colour;
+        Track<double> opacity;
+        Track<bool> flipV;
+        Track<bool> flipH;
+        Track<bool> additive;
+        // keyframes stored, with the repeated blocks counted once
+        std::size_t Count() const
+        {
+            return position.first.StoredSize() + position.second.StoredSize() + rotation.StoredSize() + scale.first.StoredSize() + scale.second.StoredSize()
+                + colour.StoredSize() + opacity.StoredSize() + flipV.StoredSize() + flipH.StoredSize() + additive.StoredSize();
+        }
+        std::size_t Simplify()
+        {
+            return position.first.Simplify() + position.second.Simplify() + rotation.Simplify() + scale.first.Simplify() + scale.second.Simplify()
+                + colour.Simplify() + opacity.Simplify() + flipV.Simplify() + flipH.Simplify() + additive.Simplify();
+        }
+        std::size_t Linearise(const LinearisationTolerance& tolerance)
+        {
+            return position.first.Linearise(tolerance.position) + position.second.Linearise(tolerance.position) + rotation.Linearise(tolerance.rotation)
+                + scale.first.Linearise(tolerance.scale) + scale.second.Linearise(tolerance.scale) + colour.Linearise(tolerance.colour) + opacity.Linearise(tolerance.opacity);
+        }
+        // replaces eased segments with linear ones that are drawn at most error pixels off, for a sprite with the given origin whose
+        // largest image is size pixels across once scaled to the frame, returning how many segments were replaced
+        std::size_t Linearise(double error, double frameScale, double size, Origin origin)
+        {
+            // eased segments can overshoot their keyframes, by at most the easing's overshoot times the track's range
+            double largestScale = 0;
+            for (const Track<double>* track : { &scale.first, &scale.second })
             {
-                keyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), 0, Easing::Step, -std::numeric_limits<double>::infinity()));
-                return keyframes;
+                double lowest = std::numeric_limits<double>::max();
+                double highest = std::numeric_limits<double>::lowest();
+                double overshoot = 0;
+                for (std::size_t i = 0; i < track->StoredSize(); i++)
+                {
+                    Keyframe<double> keyframe = track->StoredAt(i);
+                    lowest = std::min(lowest, keyframe.value);
+                    highest = std::max(highest, keyframe.value);
+                    overshoot = std::max(overshoot, easingOvershoot(keyframe.easing));
+                }
+                if (track->StoredSize() > 0)
+                    largestScale = std::max(largestScale, std::max(std::abs(lowest), std::abs(highest)) + (highest - lowest) * overshoot);
             }
-            else if constexpr (T == EventType::S)
+            LinearisationTolerance tolerance;
+            tolerance.position = error / frameScale;
+            tolerance.scale = size > 0 ? error / size : 0;
+            // a corner moves by its distance from the origin for every radian: half the diagonal for a centred origin, the whole of it for one on a corner
+            double reachX = origin == Origin::TopCentre || origin == Origin::Centre || origin == Origin::BottomCentre ? 0.5 : 1;
+            double reachY = origin == Origin::CentreLeft || origin == Origin::Centre || origin == Origin::CentreRight ? 0.5 : 1;
+            double reach = size * largestScale * std::sqrt(reachX * reachX + reachY * reachY);
+            tolerance.rotation = reach > 0 ? error / reach : 0;
+            tolerance.colour = error / 255;
+            tolerance.opacity = error / 255;
+            return Linearise(tolerance);
+        }
+        void Intern(SpriteTrackPools& pools)
+        {
+            for (Track<double>* track : { &position.first, &position.second, &rotation, &scale.first, &scale.second, &opacity })
+                pools.doubles.Intern(*track);
+            pools.colours.Intern(colour);
+            for (Track<bool>* track : { &flipV, &flipH, &additive })
+                pools.bools.Intern(*track);
+        }
+        void Compact(SpriteTrackPools& pools)
+        {
+            for (Track<double>* track : { &position.first, &position.second, &rotation, &scale.first, &scale.second, &opacity })
+                pools.doubles.Compact(*track);
+            pools.colours.Compact(colour);
+            for (Track<bool>* track : { &flipV, &flipH, &additive })
+                pools.bools.Compact(*track);
+        }
+        // sorted, disjoint [start, end) spans within activetime where the sprite may be drawn, i.e. where neither its opacity nor either
+        // of its scales is zero. the hidden spans are narrowed by a hair, so that rounding in lookups never hides a sprite that would be drawn
+        std::vector<std::pair<double, double>> VisibleSpans(std::pair<double, double> activetime) const
+        {
+            std::vector<std::pair<double, double>> hidden;
+            for (const Track<double>* track : { &opacity, &scale.first, &scale.second })
             {
-                XKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), 1, Easing::Step, -std::numeric_limits<double>::infinity()));
-                YKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), 1, Easing::Step, -std::numeric_limits<double>::infinity()));
-                return std::pair<std::vector<Keyframe<double>>, std::vector<Keyframe<double>>>(XKeyframes, YKeyframes);
+                std::vector<std::pair<double, double>> spans = track->ZeroSpans();
+                hidden.insert(hidden.end(), spans.begin(), spans.end());
             }
-            else if constexpr (T == EventType::C)
+            std::sort(hidden.begin(), hidden.end());
+            auto hair = [](double time) { return std::isfinite(time) ? 1e-9 * std::max(1.0, std::abs(time)) : 0; };
+            std::vector<std::pair<double, double>> visible;
+            double from = activetime.first;
+            for (const std::pair<double, double>& span : hidden)
             {
-                keyframes.push_back(Keyframe<Colour>(-std::numeric_limits<double>::infinity(), Colour(1, 1, 1), Easing::Step, -std::numeric_limits<double>::infinity()));
-                return keyframes;
+                double start = span.first + hair(span.first);
+                double end = span.second - hair(span.second);
+                if (!(start < end)) continue;
+                if (start > from) visible.emplace_back(from, std::min(start, activetime.second));
+                from = std::max(from, end);
+                if (from >= activetime.second) break;
             }
-            else if constexpr (T == EventType::F)
+            if (from < activetime.second) visible.emplace_back(from, activetime.second);
+            visible.erase(std::remove_if(visible.begin(), visible.end(), [](const std::pair<double, double>& span) { return !(span.first < span.second); }), visible.end());
+            return visible;
+        }
+        SpriteState StateAt(double time, SpriteCursor& cursor, bool easingTables = false) const
+        {
+            SpriteState state;
+            state.position = { position.first.ValueAt(time, cursor.position.first, easingTables), position.second.ValueAt(time, cursor.position.second, easingTables) };
+            state.rotation = rotation.ValueAt(time, cursor.rotation, easingTables);
+            state.scale = { scale.first.ValueAt(time, cursor.scale.first, easingTables), scale.second.ValueAt(time, cursor.scale.second, easingTables) };
+            state.colour = colour.ValueAt(time, cursor.colour, easingTables);
+            state.opacity = opacity.ValueAt(time, cursor.opacity, easingTables);
+            state.flipV = flipV.ValueAt(time, cursor.flipV);
+            state.flipH = flipH.ValueAt(time, cursor.flipH);
+            state.additive = additive.ValueAt(time, cursor.additive);
+            return state;
+        }
+    };
+
+    // one of the tracks in a TrackTable, shifted by timeOffset
+    struct TrackHandle
+    {
+        double timeOffset = 0;
+        std::uint32_t index = 0;
+    };
+
+    // each distinct track once, however many sprites use it and at whatever time offsets, so that sprites only hold a TrackHandle per track.
+    // tracks are the same when they share their keyframes and repeat the same way, which after interning is most of a particle effect's
+    template <typename T>
+    class TrackTable
+    {
+    public:
+        TrackHandle Add(Track<T> track)
+        {
+            TrackHandle handle;
+            handle.timeOffset = track.timeOffset;
+            track.timeOffset = 0;
+            auto key = std::make_tuple((const void*)track.keyframes.get(), (const void*)track.compact.get(), (const void*)track.offsets.get(),
+                track.repeatBegin, track.repeatSize, track.copies, track.firstOffset, track.period, track.sorted);
+            auto k = indices.find(key);
+            if (k == indices.end())
             {
-                keyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), 1, Easing::Step, -std::numeric_limits<double>::infinity()));
-                return keyframes;
+                k = indices.emplace(key, (std::uint32_t)tracks.size()).first;
+                tracks.push_back(std::move(track));
             }
-            else if constexpr (T == EventType::P)
+            handle.index = k->second;
+            return handle;
+        }
+        // drops what's only needed while adding tracks
+        void Finish()
+        {
+            indices.clear();
+            tracks.shrink_to_fit();
+        }
+        T ValueAt(TrackHandle handle, double time, std::uint32_t& cursor, bool easingTables = false) const
+        {
+            return tracks[handle.index].ValueAt(time - handle.timeOffset, cursor, easingTables);
+        }
+        std::size_t Size() const
+        {
+            return tracks.size();
+        }
+    private:
+        std::vector<Track<T>> tracks;
+        std::map<std::tuple<const void*, const void*, const void*, std::uint32_t, std::uint32_t, std::uint32_t, std::uint32_t, double, bool>, std::uint32_t> indices;
+    };
+
+    // SpriteKeyframes as handles into RenderTracks
+    struct RenderKeyframes
+    {
+        std::pair<TrackHandle, TrackHandle> position;
+        TrackHandle rotation;
+        std::pair<TrackHandle, TrackHandle> scale;
+        TrackHandle colour;
+        TrackHandle opacity;
+        TrackHandle flipV;
+        TrackHandle flipH;
+        TrackHandle additive;
+    };
+
+    // the tracks of every render sprite of a storyboard
+    struct RenderTracks
+    {
+        TrackTable<double> doubles;
+        TrackTable<Colour> colours;
+        TrackTable<bool> bools;
+        RenderKeyframes Add(const SpriteKeyframes& keyframes)
+        {
+            RenderKeyframes handles;
+            handles.position = { doubles.Add(keyframes.position.first), doubles.Add(keyframes.position.second) };
+            handles.rotation = doubles.Add(keyframes.rotation);
+            handles.scale = { doubles.Add(keyframes.scale.first), doubles.Add(keyframes.scale.second) };
+            handles.colour = colours.Add(keyframes.colour);
+            handles.opacity = doubles.Add(keyframes.opacity);
+            handles.flipV = bools.Add(keyframes.flipV);
+            handles.flipH = bools.Add(keyframes.flipH);
+            handles.additive = bools.Add(keyframes.additive);
+            return handles;
+        }
+        void Finish()
+        {
+            doubles.Finish();
+            colours.Finish();
+            bools.Finish();
+        }
+        std::size_t Size() const
+        {
+            return doubles.Size() + colours.Size() + bools.Size();
+        }
+        // the same as SpriteKeyframes::StateAt on the keyframes the handles were made from
+        SpriteState StateAt(const RenderKeyframes& keyframes, double time, SpriteCursor& cursor, bool easingTables = false) const
+        {
+            SpriteState state;
+            state.position = { doubles.ValueAt(keyframes.position.first, time, cursor.position.first, easingTables), doubles.ValueAt(keyframes.position.second, time, cursor.position.second, easingTables) };
+            state.rotation = doubles.ValueAt(keyframes.rotation, time, cursor.rotation, easingTables);
+            state.scale = { doubles.ValueAt(keyframes.scale.first, time, cursor.scale.first, easingTables), doubles.ValueAt(keyframes.scale.second, time, cursor.scale.second, easingTables) };
+            state.colour = colours.ValueAt(keyframes.colour, time, cursor.colour, easingTables);
+            state.opacity = doubles.ValueAt(keyframes.opacity, time, cursor.opacity, easingTables);
+            state.flipV = bools.ValueAt(keyframes.flipV, time, cursor.flipV);
+            state.flipH = bools.ValueAt(keyframes.flipH, time, cursor.flipH);
+            state.additive = bools.ValueAt(keyframes.additive, time, cursor.additive);
+            return state;
+        }
+    };
+
+    // groups of commands that feed the same tracks, and so only interact with each other
+    enum class Channel
+    {
+        Position,
+        Scale,
+        Rotation,
+        Colour,
+        Opacity,
+        Parameter,
+        None
+    };
+    Channel eventChannel(EventType type)
+    {
+        switch (type)
+        {
+        case EventType::M: case EventType::MX: case EventType::MY: return Channel::Position;
+        case EventType::S: case EventType::V: return Channel::Scale;
+        case EventType::R: return Channel::Rotation;
+        case EventType::C: return Channel::Colour;
+        case EventType::F: return Channel::Opacity;
+        case EventType::P: return Channel::Parameter;
+        default: return Channel::None;
+        }
+    }
+
+    // a loop or trigger whose first three iterations are expanded into events while the rest are left to the keyframe compiler
+    // a trigger's iterations are its activations, which start at the shared sorted activation times rather than every period
+    struct RepeatedGroup
+    {
+        double starttime;
+        double period;
+        int count;
+        std::shared_ptr<const std::vector<double>> activations;
+        // time of a command of the group in the given iteration
+        double TimeIn(int iteration, double time) const
+        {
+            return activations ? (*activations)[iteration] + time : starttime + time + period * iteration;
+        }
+        double Shift(int from, int to) const
+        {
+            return activations ? (*activations)[to] - (*activations)[from] : period * (to - from);
+        }
+    };
+
+    // a track being compiled
+    // an iteration's keyframes only depend on its events and the time of the keyframe it starts after, so once the second iteration of a
+    // symbolically evaluated loop starts one period after the first did, every later one is the second moved along by a whole period.
+    // the second then becomes the track's repeated block and the third stands in for the last; otherwise the remaining iterations are
+    // added one by one, same as an unrolled loop
+    // trigger activations aren't evenly spaced, so there every activation has to start after the keyframes of the one before have ended
+    template <typename T>
+    struct TrackBuilder
+    {
+        template <typename V, typename Selector>
+        void Add(const EventArena& arena, const EventInstance& event, const ActivationTable& activations, const std::vector<RepeatedGroup>& repeats, Selector W)
+        {
+            if (event.repeat != repeat) Finish<V>(arena, activations, repeats, W);
+            if (event.repeat != 0)
             {
-                keyframes.push_back(Keyframe<bool>(-std::numeric_limits<double>::infinity(), false, Easing::Step, -std::numeric_limits<double>::infinity()));
-                return keyframes;
+                repeat = event.repeat;
+                if (event.iteration < 3 && (lastIteration.empty() || lastIteration.back().iteration != event.iteration))
+                {
+                    iterationStarts[event.iteration] = keyframes.size();
+                    entryTimes[event.iteration] = keyframes.empty() ? std::numeric_limits<double>::quiet_NaN() : keyframes.back().time;
+                    firstStarts[event.iteration] = event.starttime;
+                    lastIteration.clear();
+                }
+                lastIteration.push_back(event);
             }
+            addEventKeyframes<T, V>(keyframes, arena, event, activations, W);
         }
-        if constexpr (T == EventType::M || T == EventType::S)
+        template <typename V, typename Selector>
+        void Finish(const EventArena& arena, const ActivationTable& activations, const std::vector<RepeatedGroup>& repeats, Selector W)
         {
-            bool compatibilityMode = applicableEvents[0]->GetType() == EventType::M || applicableEvents[0]->GetType() == EventType::V;
-            auto applicableEventsXY = std::vector<std::unique_ptr<Event<std::pair<double, double>>>>();
-            auto applicableEventsX = std::vector<std::unique_ptr<Event<double>>>();
-            auto applicableEventsY = std::vector<std::unique_ptr<Event<double>>>();
-            if (compatibilityMode)
+            if (repeat == 0) return;
+            const RepeatedGroup& group = repeats[repeat - 1];
+            repeat = 0;
+            std::size_t blockSize = iterationStarts[2] - iterationStarts[1];
+            bool settled = copies == 1 && lastIteration.back().iteration == 2
+                && keyframes.size() - iterationStarts[2] == blockSize;
+            if (settled && group.activations)
+            {
+                const std::vector<double>& times = *group.activations;
+                double lead = firstStarts[1] - times[1];
+                double tail = entryTimes[2] - times[1];
+                settled = entryTimes[1] <= firstStarts[1];
+                for (int i = 2; i < group.count && settled; i++)
+                    settled = times[i - 1] + tail <= times[i] + lead;
+            }
+            else if (settled)
+                settled = entryTimes[2] == entryTimes[1] + group.period;
+            if (settled)
             {
-                for (const std::unique_ptr<IEvent>& event : applicableEvents)
+                // the third iteration's keyframes stand in for the last iteration's
+                double shift = group.Shift(2, group.count - 1);
+                for (std::size_t i = iterationStarts[2]; i < keyframes.size(); i++)
                 {
-                    EventType type = event->GetType();
-                    if (type == EventType::M)
-                        applicableEventsXY.push_back(std::make_unique<Event<std::pair<double, double>>>(*dynamic_cast<Event<std::pair<double, double>>*>(event->copy().get())));
-                    if (type == EventType::V)
-                        applicableEventsXY.push_back(std::make_unique<Event<std::pair<double, double>>>(*dynamic_cast<Event<std::pair<double, double>>*>(event->copy().get())));
+                    keyframes[i].time += shift;
+                    keyframes[i].interpolationOffset += shift;
                 }
+                repeatBegin = (std::uint32_t)iterationStarts[1];
+                repeatSize = (std::uint32_t)blockSize;
+                copies = group.count - 2;
+                period = group.activations ? 0 : group.period;
+                offsets = group.activations;
+                firstOffset = group.activations ? 1 : 0;
             }
             else
             {
-                for (const std::unique_ptr<IEvent>& event : applicableEvents)
-                {
-                    EventType type = event->GetType();
-                    if (type == EventType::MX)
-                        applicableEventsX.push_back(std::make_unique<Event<double>>(*dynamic_cast<Event<double>*>(event->copy().get())));
-                    if (type == EventType::MY)
-                        applicableEventsY.push_back(std::make_unique<Event<double>>(*dynamic_cast<Event<double>*>(event->copy().get())));
-                    if (type == EventType::S)
+                for (int i = lastIteration.back().iteration + 1; i < group.count; i++)
+                    for (EventInstance event : lastIteration)
                     {
-                        applicableEventsX.push_back(std::make_unique<Event<double>>(*dynamic_cast<Event<double>*>(event->copy().get())));
-                        applicableEventsY.push_back(std::make_unique<Event<double>>(*dynamic_cast<Event<double>*>(event->copy().get())));
+                        event.starttime = group.TimeIn(i, arena.GetStartTime(event.index));
+                        event.endtime = group.TimeIn(i, arena.GetEndTime(event.index));
+                        if (event.triggerID != 0) event.triggerID += i - event.iteration;
+                        addEventKeyframes<T, V>(keyframes, arena, event, activations, W);
                     }
-                }
             }
-            struct first
-            {
-                double operator()(std::pair<double, double> in) { return in.first; }
-            };
-            struct second
+            lastIteration.clear();
+        }
+        Track<T> Build(T initialValue)
+        {
+            // tracks without events hold the sprite's initial state
+            if (keyframes.empty())
+                keyframes.emplace_back(-std::numeric_limits<double>::infinity(), initialValue, Easing::Step, -std::numeric_limits<double>::infinity());
+            return Track<T>(std::move(keyframes), repeatBegin, repeatSize, copies, period, std::move(offsets), firstOffset);
+        }
+        std::vector<Keyframe<T>> keyframes;
+        std::uint16_t repeat = 0;
+        std::size_t iterationStarts[3] = {};
+        double entryTimes[3] = {};
+        double firstStarts[3] = {};
+        std::vector<EventInstance> lastIteration;
+        std::uint32_t repeatBegin = 0;
+        std::uint32_t repeatSize = 0;
+        std::uint32_t copies = 1;
+        double period = 0;
+        std::shared_ptr<const std::vector<double>> offsets;
+        std::uint32_t firstOffset = 0;
+    };
+
+    // builds every track of a sprite in one pass over its sorted events, sending each event straight to the track(s) it animates
+    // move and scale take their mode from their first event: M/V set both axes, MX/MY/S set them separately, and events of the other kind are ignored
+    void compileKeyframes(SpriteKeyframes& keyframes, const EventArena& arena, const std::vector<EventInstance>& events, std::pair<double, double> coordinates, const ActivationTable& activations, const std::vector<RepeatedGroup>& repeats)
+    {
+        std::pair<TrackBuilder<double>, TrackBuilder<double>> position;
+        TrackBuilder<double> rotation;
+        std::pair<TrackBuilder<double>, TrackBuilder<double>> scale;
+        TrackBuilder<Colour> colour;
+        TrackBuilder<double> opacity;
+        TrackBuilder<bool> flipH;
+        TrackBuilder<bool> flipV;
+        TrackBuilder<bool> additive;
+        std::optional<bool> positionPairs;
+        std::optional<bool> scalePairs;
+        for (const EventInstance& event : events)
+        {
+            EventType type = arena.GetType(event.index);
+            switch (type)
             {
-                double operator()(std::pair<double, double> in) { return in.second; }
-            };
-            if (compatibilityMode)
+            case EventType::M:
+            case EventType::V:
             {
-                generateKeyframes<double, std::pair<double, double>>(XKeyframes, applicableEventsXY, activations, first());
-                generateKeyframes<double, std::pair<double, double>>(YKeyframes, applicableEventsXY, activations, second());
+                std::optional<bool>& pairs = type == EventType::M ? positionPairs : scalePairs;
+                auto& tracks = type == EventType::M ? position : scale;
+                if (!pairs.has_value()) pairs = true;
+                if (!*pairs) break;
+                tracks.first.Add<std::pair<double, double>>(arena, event, activations, repeats, first());
+                tracks.second.Add<std::pair<double, double>>(arena, event, activations, repeats, second());
             }
-            else
+            break;
+            case EventType::MX:
+            case EventType::MY:
+            case EventType::S:
             {
-                if (applicableEventsX.size() == 0)
-                    if constexpr (T == EventType::M)
-                        XKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), coordinates.first, Easing::Step, -std::numeric_limits<double>::infinity()));
-                    else
-                        XKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), 1, Easing::Step, -std::numeric_limits<double>::infinity()));
-                else
-                    generateKeyframes<double, double>(XKeyframes, applicableEventsX, activations, nop<double>());
-                if (applicableEventsY.size() == 0)
-                    if constexpr (T == EventType::M)
-                        YKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), coordinates.second, Easing::Step, -std::numeric_limits<double>::infinity()));
-                    else
-                        YKeyframes.push_back(Keyframe<double>(-std::numeric_limits<double>::infinity(), 1, Easing::Step, -std::numeric_limits<double>::infinity()));
+                std::optional<bool>& pairs = type == EventType::S ? scalePairs : positionPairs;
+                if (!pairs.has_value()) pairs = false;
+                if (*pairs) break;
+                if (type == EventType::MX) position.first.Add<double>(arena, event, activations, repeats, nop<double>());
+                else if (type == EventType::MY) position.second.Add<double>(arena, event, activations, repeats, nop<double>());
                 else
-                    generateKeyframes<double, double>(YKeyframes, applicableEventsY, activations, nop<double>());
+                {
+                    scale.first.Add<double>(arena, event, activations, repeats, nop<double>());
+                    scale.second.Add<double>(arena, event, activations, repeats, nop<double>());
+                }
+            }
+            break;
+            case EventType::R:
+                rotation.Add<double>(arena, event, activations, repeats, nop<double>());
+                break;
+            case EventType::F:
+                opacity.Add<double>(arena, event, activations, repeats, nop<double>());
+                break;
+            case EventType::C:
+                colour.Add<Colour>(arena, event, activations, repeats, nop<Colour>());
+                break;
+            case EventType::P:
+            {
+                ParameterType parameter = arena.GetStartValue<ParameterType>(event.index);
+                TrackBuilder<bool>& track = parameter == ParameterType::FlipH ? flipH : parameter == ParameterType::FlipV ? flipV : additive;
+                track.Add<ParameterType>(arena, event, activations, repeats, nop<ParameterType>());
+            }
+            break;
+            default:
+                break;
             }
-            return std::pair<std::vector<Keyframe<double>>, std::vector<Keyframe<double>>>(XKeyframes, YKeyframes);
         }
-        else if constexpr (T == EventType::C)
+
+        auto finish = [&](auto& track, auto pairs, auto W)
         {
-            auto ev = std::vector<std::unique_ptr<Event<Colour>>>();
-            for (const auto& e : applicableEvents)
-                ev.push_back(std::make_unique<Event<Colour>>(*dynamic_cast<Event<Colour>*>(e->copy().get())));
-            generateKeyframes<Colour, Colour>(keyframes, ev, activations, nop<Colour>());
-            return keyframes;
+            using V = std::conditional_t<std::is_same_v<decltype(pairs), std::true_type>, std::pair<double, double>, double>;
+            track.template Finish<V>(arena, activations, repeats, W);
+        };
+        if (positionPairs.value_or(false))
+        {
+            finish(position.first, std::true_type(), first());
+            finish(position.second, std::true_type(), second());
         }
-        else if constexpr (T == EventType::P)
+        else
         {
-            auto ev = std::vector<std::unique_ptr<Event<ParameterType>>>();
-            for (const auto& e : applicableEvents)
-                ev.push_back(std::make_unique<Event<ParameterType>>(*dynamic_cast<Event<ParameterType>*>(e->copy().get())));
-            generateKeyframes<bool, ParameterType>(keyframes, ev, activations, nop<ParameterType>());
-            return keyframes;
+            finish(position.first, std::false_type(), nop<double>());
+            finish(position.second, std::false_type(), nop<double>());
+        }
+        if (scalePairs.value_or(false))
+        {
+            finish(scale.first, std::true_type(), first());
+            finish(scale.second, std::true_type(), second());
         }
         else
         {
-            auto ev = std::vector<std::unique_ptr<Event<double>>>();
-            for (const auto& e : applicableEvents)
-                ev.push_back(std::make_unique<Event<double>>(*dynamic_cast<Event<double>*>(e->copy().get())));
-            generateKeyframes<double, double>(keyframes, ev, activations, nop<double>());
-            return keyframes;
+            finish(scale.first, std::false_type(), nop<double>());
+            finish(scale.second, std::false_type(), nop<double>());
         }
+        finish(rotation, std::false_type(), nop<double>());
+        finish(opacity, std::false_type(), nop<double>());
+        colour.Finish<Colour>(arena, activations, repeats, nop<Colour>());
+        flipH.Finish<ParameterType>(arena, activations, repeats, nop<ParameterType>());
+        flipV.Finish<ParameterType>(arena, activations, repeats, nop<ParameterType>());
+        additive.Finish<ParameterType>(arena, activations, repeats, nop<ParameterType>());
+
+        keyframes.position = { position.first.Build(coordinates.first), position.second.Build(coordinates.second) };
+        keyframes.rotation = rotation.Build(0);
+        keyframes.scale = { scale.first.Build(1), scale.second.Build(1) };
+        keyframes.colour = colour.Build(Colour(1, 1, 1));
+        keyframes.opacity = opacity.Build(1);
+        keyframes.flipH = flipH.Build(false);
+        keyframes.flipV = flipV.Build(false);
+        keyframes.additive = additive.Build(false);
     }
 }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+#include <cstddef>
+
+namespace sb
+{
+    // read-only view of a whole file mapped into memory
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const std::filesystem::path& filepath);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        ~MappedFile();
+        bool IsOpen() const
+        {
+            return open;
+        }
+        std::string_view GetView() const
+        {
+            return std::string_view(data, size);
+        }
+        std::size_t GetSize() const
+        {
+            return size;
+        }
+    private:
+        void Close();
+        const char* data = nullptr;
+        std::size_t size = 0;
+        bool open = false;
+    };
+}
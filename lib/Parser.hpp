@@ -2,21 +2,122 @@
 
 #include <Components.hpp>
 #include <Helpers.hpp>
+#include <MappedFile.hpp>
+#include <SongFolder.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <filesystem>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
+#include <array>
 #include <utility>
 #include <memory>
+#include <optional>
 #include <exception>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include <omp.h>
 
 namespace sb
 {
+    struct ControlPoint
+    {
+        ControlPoint() = default;
+        ControlPoint(double time, double beatLength)
+            :
+            time(time),
+            beatLength(beatLength)
+        {}
+        double time = 0;
+        double beatLength = 0;
+        double sliderMultiplier = beatLength >= 0 ? 1.0 : 100.0 / -beatLength;
+        int meter = 4;
+        int sampleSet = 0;
+        int sampleIndex = 0;
+        int volume = 100;
+        bool uninherited = 1;
+        int effects = 0;
+    };
+
+    // timing points split into uninherited (bpm) and inherited (slider velocity) points, sorted by time
+    // lookups go through a cursor per kind, so walking hit objects in order costs amortised O(1) per lookup,
+    // and anything out of order falls back to a binary search
+    class TimingPointIndex
+    {
+    public:
+        void Add(const ControlPoint& controlPoint)
+        {
+            (controlPoint.uninherited ? timingPoints : inheritedPoints).push_back(controlPoint);
+            sorted = false;
+        }
+        // the point in effect just before time, or a default point if there is none
+        const ControlPoint& TimingPointAt(double time)
+        {
+            return pointBefore(timingPoints, timingCursor, time);
+        }
+        const ControlPoint& InheritedPointAt(double time)
+        {
+            return pointBefore(inheritedPoints, inheritedCursor, time);
+        }
+        void SetSliderMultiplier(double multiplier)
+        {
+            sliderMultiplier = multiplier;
+        }
+        // duration of a single slide of a slider with the given pixel length starting at time
+        double SliderTravelDuration(double time, double length)
+        {
+            return TimingPointAt(time).beatLength * length / sliderMultiplier / 100.0 / InheritedPointAt(time).sliderMultiplier;
+        }
+    private:
+        const ControlPoint& pointBefore(std::vector<ControlPoint>& points, std::size_t& cursor, double time)
+        {
+            static const ControlPoint none;
+            if (!sorted) sort();
+            // cursor is the number of points before time
+            if (cursor > 0 && points[cursor - 1].time >= time)
+                cursor = std::lower_bound(points.begin(), points.end(), time, [](const ControlPoint& point, double time) {
+                    return point.time < time;
+                    }) - points.begin();
+            while (cursor < points.size() && points[cursor].time < time) cursor++;
+            return cursor == 0 ? none : points[cursor - 1];
+        }
+        void sort()
+        {
+            auto byTime = [](const ControlPoint& a, const ControlPoint& b) {
+                return a.time < b.time;
+            };
+            std::stable_sort(timingPoints.begin(), timingPoints.end(), byTime);
+            std::stable_sort(inheritedPoints.begin(), inheritedPoints.end(), byTime);
+            timingCursor = 0;
+            inheritedCursor = 0;
+            sorted = true;
+        }
+        std::vector<ControlPoint> timingPoints;
+        std::vector<ControlPoint> inheritedPoints;
+        std::size_t timingCursor = 0;
+        std::size_t inheritedCursor = 0;
+        double sliderMultiplier = 1.4; // osu!'s default when the difficulty doesn't set one
+        bool sorted = true;
+    };
+
+    enum class Section
+    {
+        None,
+        Events,
+        Variables,
+        Info,
+        TimingPoints,
+        HitObjects
+    };
+
     // written mostly in reference to the parser used in osu!lazer (https://github.com/ppy/osu/blob/master/osu.Game/Beatmaps/Formats/LegacyStoryboardDecoder.cs)
-    void parseFile(std::ifstream& file, size_t& lineNumber, std::unordered_map<std::string, std::string>& variables, std::vector<std::unique_ptr<Sprite>>& sprites, std::vector<Sample>& samples, std::vector<std::pair<double, HitSound>>& hitSounds, Background& background, Video& video, std::unordered_map<std::string, std::string>& info)
+    void parseFile(std::istream& file, size_t& lineNumber, Variables& variables, std::vector<std::unique_ptr<Sprite>>& sprites, std::vector<Sample>& samples, std::vector<std::pair<double, HitSound>>& hitSounds, Background& background, Video& video, std::unordered_map<std::string, std::string>& info)
     {
         // check for utf-8 bom, which is present when exported through storybrew
         char buf[4];
@@ -27,38 +128,13 @@ namespace sb
         else file.seekg(0);
 
         std::string line;
+        std::string expanded;
+        std::shared_ptr<EventArena> arena = std::make_shared<EventArena>();
         bool inLoop = false;
         bool inTrigger = false;
         bool hasBackground = false;
         bool hasVideo = false;
-        struct ControlPoint
-        {
-            ControlPoint() = default;
-            ControlPoint(double time, double beatLength)
-                :
-                time(time),
-                beatLength(beatLength)
-            {}
-            double time = 0;
-            double beatLength = 0;
-            double sliderMultiplier = beatLength >= 0 ? 1.0 : 100.0 / -beatLength;
-            int meter = 4;
-            int sampleSet = 0;
-            int sampleIndex = 0;
-            int volume = 100;
-            bool uninherited = 1;
-            int effects = 0;
-        };
         std::vector<ControlPoint> controlPoints;
-        enum class Section
-        {
-            None,
-            Events,
-            Variables,
-            Info,
-            TimingPoints,
-            HitObjects
-        };
         Section section = Section::None;
 
         while (file.good())
@@ -73,6 +149,7 @@ namespace sb
             if (line.rfind("//", 0) == 0) continue;
 
             // Determine start of a new section
+            if (line[0] == '[' && section == Section::Variables) variables.Compile();
             if (line.find("[Events]") == 0)
             {
                 section = Section::Events;
@@ -115,7 +192,8 @@ namespace sb
                 while (line[depth] == ' ' || line[depth] == '_') depth++;
                 line.erase(0, depth);
 
-                applyVariables(line, variables);
+                if (variables.Apply(line, expanded).data() == expanded.data())
+                    line.swap(expanded);
                 std::vector<std::string> split = stringSplit(line, ",");
 
                 if (inTrigger && depth < 2) inTrigger = false;
@@ -149,7 +227,7 @@ namespace sb
                     std::string path = removePathQuotes(split[3]);
                     float x = std::stof(split[4]);
                     float y = std::stof(split[5]);
-                    sprites.push_back(std::make_unique<Sprite>(layer, origin, path, std::pair<double, double>(x, y)));
+                    sprites.push_back(std::make_unique<Sprite>(layer, origin, path, std::pair<double, double>(x, y), arena));
                 }
                 break;
                 case Keyword::Animation:
@@ -162,7 +240,7 @@ namespace sb
                     int frameCount = std::stoi(split[6]);
                     double frameDelay = std::stod(split[7]);
                     LoopType loopType = parseEnum(LoopTypeStrings, split[8]).value_or(LoopType::LoopForever);
-                    sprites.push_back(std::make_unique<class Animation>(layer, origin, path, std::pair<double, double>(x, y), frameCount, frameDelay, loopType));
+                    sprites.push_back(std::make_unique<class Animation>(layer, origin, path, std::pair<double, double>(x, y), frameCount, frameDelay, loopType, arena));
                 }
                 break;
                 case Keyword::Sample:
@@ -220,20 +298,18 @@ namespace sb
                     {
                         double startValue = std::stod(split[4]);
                         double endValue = split.size() > 5 ? std::stod(split[5]) : startValue;
-                        std::unique_ptr<Event<double>> event = std::make_unique<Event<double>>(EventType::F, easing, starttime, endTime, startValue, endValue);
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::F, easing, starttime, endTime, startValue, endValue);
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::F, easing, starttime, endTime, startValue, endValue);
+                        else (*(sprites.end() - 1))->AddEvent(EventType::F, easing, starttime, endTime, startValue, endValue);
                     }
                     break;
                     case EventType::S:
                     {
                         double startValue = std::stod(split[4]);
                         double endValue = split.size() > 5 ? std::stod(split[5]) : startValue;
-                        std::unique_ptr<Event<double>> event = std::make_unique<Event<double>>(EventType::S, easing, starttime, endTime, startValue, endValue);
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::S, easing, starttime, endTime, startValue, endValue);
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::S, easing, starttime, endTime, startValue, endValue);
+                        else (*(sprites.end() - 1))->AddEvent(EventType::S, easing, starttime, endTime, startValue, endValue);
                     }
                     break;
                     case EventType::V:
@@ -242,20 +318,18 @@ namespace sb
                         double startY = std::stod(split[5]);
                         double endX = split.size() > 6 ? std::stod(split[6]) : startX;
                         double endY = split.size() > 7 ? std::stod(split[7]) : startY;
-                        std::unique_ptr<Event<std::pair<double, double>>> event = std::make_unique<Event<std::pair<double, double>>>(EventType::V, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::V, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::V, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
+                        else (*(sprites.end() - 1))->AddEvent(EventType::V, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
                     }
                     break;
                     case EventType::R:
                     {
                         double startValue = std::stod(split[4]);
                         double endValue = split.size() > 5 ? std::stod(split[5]) : startValue;
-                        std::unique_ptr<Event<double>> event = std::make_unique<Event<double>>(EventType::R, easing, starttime, endTime, startValue, endValue);
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::R, easing, starttime, endTime, startValue, endValue);
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::R, easing, starttime, endTime, startValue, endValue);
+                        else (*(sprites.end() - 1))->AddEvent(EventType::R, easing, starttime, endTime, startValue, endValue);
                     }
                     break;
                     case EventType::M:
@@ -264,30 +338,27 @@ namespace sb
                         double startY = std::stod(split[5]);
                         double endX = split.size() > 6 ? std::stod(split[6]) : startX;
                         double endY = split.size() > 7 ? std::stod(split[7]) : startY;
-                        std::unique_ptr<Event<std::pair<double, double>>> event = std::make_unique<Event<std::pair<double, double>>>(EventType::M, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::M, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::M, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
+                        else (*(sprites.end() - 1))->AddEvent(EventType::M, easing, starttime, endTime, std::pair<double, double> { startX, startY }, std::pair<double, double>{ endX, endY });
                     }
                     break;
                     case EventType::MX:
                     {
                         double startValue = std::stod(split[4]);
                         double endValue = split.size() > 5 ? std::stod(split[5]) : startValue;
-                        std::unique_ptr<Event<double>> event = std::make_unique<Event<double>>(EventType::MX, easing, starttime, endTime, startValue, endValue);
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::MX, easing, starttime, endTime, startValue, endValue);
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::MX, easing, starttime, endTime, startValue, endValue);
+                        else (*(sprites.end() - 1))->AddEvent(EventType::MX, easing, starttime, endTime, startValue, endValue);
                     }
                     break;
                     case EventType::MY:
                     {
                         double startValue = std::stod(split[4]);
                         double endValue = split.size() > 5 ? std::stod(split[5]) : startValue;
-                        std::unique_ptr<Event<double>> event = std::make_unique<Event<double>>(EventType::MY, easing, starttime, endTime, startValue, endValue);
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::MY, easing, starttime, endTime, startValue, endValue);
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::MY, easing, starttime, endTime, startValue, endValue);
+                        else (*(sprites.end() - 1))->AddEvent(EventType::MY, easing, starttime, endTime, startValue, endValue);
                     }
                     break;
                     case EventType::C:
@@ -298,31 +369,17 @@ namespace sb
                         int endR = split.size() > 7 ? std::stoi(split[7]) : startR;
                         int endG = split.size() > 8 ? std::stoi(split[8]) : startG;
                         int endB = split.size() > 9 ? std::stoi(split[9]) : startB;
-                        std::unique_ptr<Event<Colour>> event = std::make_unique<Event<Colour>>(EventType::C, easing, starttime, endTime, Colour { startR / 255.0f, startG / 255.0f, startB / 255.0f }, Colour{ endR / 255.0f, endG / 255.0f, endB / 255.0f });
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::C, easing, starttime, endTime, Colour { startR / 255.0f, startG / 255.0f, startB / 255.0f }, Colour{ endR / 255.0f, endG / 255.0f, endB / 255.0f });
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::C, easing, starttime, endTime, Colour { startR / 255.0f, startG / 255.0f, startB / 255.0f }, Colour{ endR / 255.0f, endG / 255.0f, endB / 255.0f });
+                        else (*(sprites.end() - 1))->AddEvent(EventType::C, easing, starttime, endTime, Colour { startR / 255.0f, startG / 255.0f, startB / 255.0f }, Colour{ endR / 255.0f, endG / 255.0f, endB / 255.0f });
                     }
                     break;
                     case EventType::P:
                     {
                         ParameterType parameterType = ParameterTypeStrings.find(split[4])->second;
-                        std::unique_ptr<Event<ParameterType>> event;
-                        switch (parameterType)
-                        {
-                        case ParameterType::Additive:
-                            event = std::make_unique<Event<ParameterType>>(EventType::P, easing, starttime, endTime, ParameterType::Additive, ParameterType::Additive);
-                            break;
-                        case ParameterType::FlipH:
-                            event = std::make_unique<Event<ParameterType>>(EventType::P, easing, starttime, endTime, ParameterType::FlipH, ParameterType::FlipH);
-                            break;
-                        case ParameterType::FlipV:
-                            event = std::make_unique<Event<ParameterType>>(EventType::P, easing, starttime, endTime, ParameterType::FlipV, ParameterType::FlipV);
-                            break;
-                        }
-                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(std::move(event));
-                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(std::move(event));
-                        else (*(sprites.end() - 1))->AddEvent(std::move(event));
+                        if (inTrigger) (*(sprites.end() - 1))->AddEventInTrigger(EventType::P, easing, starttime, endTime, parameterType, parameterType);
+                        else if (inLoop) (*(sprites.end() - 1))->AddEventInLoop(EventType::P, easing, starttime, endTime, parameterType, parameterType);
+                        else (*(sprites.end() - 1))->AddEvent(EventType::P, easing, starttime, endTime, parameterType, parameterType);
                     }
                     break;
                     case EventType::None:
@@ -340,7 +397,7 @@ namespace sb
                 if (splitPos == std::string::npos || splitPos == line.length() - 1) continue;
                 std::string key = line.substr(0, splitPos);
                 std::string value = line.substr(splitPos + 1, line.length() - splitPos - 1);
-                variables.emplace(key, value); // TODO: Error if already exists
+                variables.Add(key, value);
             }
             break;
 
@@ -420,9 +477,472 @@ namespace sb
             break;
             }
         }
+        variables.Compile();
+    }
+
+    // reads the next line, dropping the line ending; pos is left at the start of the following line
+    bool nextLine(std::string_view data, std::size_t& pos, std::string_view& line)
+    {
+        if (pos >= data.size()) return false;
+        std::size_t end = data.find('\n', pos);
+        if (end == std::string_view::npos) end = data.size();
+        line = data.substr(pos, end - pos);
+        pos = std::min(end + 1, data.size());
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        return true;
+    }
+
+    // parses the body of an [Events] section, or any part of one that starts on an object boundary, and returns the number of lines read
+    // if sources is given, it receives the text each sprite was parsed from (its object line up to the next sprite), as views into data
+    std::size_t parseEvents(std::string_view data, const Variables& variables, std::vector<std::unique_ptr<Sprite>>& sprites, std::vector<Sample>& samples, Background& background, Video& video, std::vector<std::string_view>* sources = nullptr)
+    {
+        std::shared_ptr<EventArena> arena = std::make_shared<EventArena>();
+        std::string expanded;
+        std::array<std::string_view, 16> split;
+        bool inLoop = false;
+        bool inTrigger = false;
+        std::size_t lineNumber = 0;
+        std::size_t pos = 0;
+        std::size_t lineStart = 0;
+        std::optional<std::size_t> sourceStart;
+        std::string_view line;
+        auto addSource = [&]()
+        {
+            if (sources == nullptr) return;
+            if (sourceStart.has_value()) sources->push_back(data.substr(*sourceStart, lineStart - *sourceStart));
+            sourceStart = lineStart;
+        };
+        while (nextLine(data, pos, line))
+        {
+            lineStart = line.data() - data.data();
+            lineNumber++;
+            if (line.length() == 0) continue;
+            if (line.rfind("//", 0) == 0) continue;
+
+            std::size_t depth = 0;
+            while (depth < line.size() && (line[depth] == ' ' || line[depth] == '_')) depth++;
+            line.remove_prefix(depth);
+
+            line = variables.Apply(line, expanded);
+            std::size_t count = splitView(line, ',', split);
+
+            if (inTrigger && depth < 2) inTrigger = false;
+            if (inLoop && depth < 2) inLoop = false;
+
+            Keyword keyword = parseKeyword(split[0]).value_or(Keyword::None);
+            switch (keyword)
+            {
+            case Keyword::Background:
+            {
+                std::string path = removePathQuotes(split[2]);
+                std::pair<double, double> offset = count < 3 ? std::pair<double, double>(parseNumber<int>(split[3]), parseNumber<int>(split[4])) : std::pair<double, double>(0, 0);
+                background = Background(path, offset);
+            }
+            break;
+            case Keyword::Video:
+            {
+                double starttime = parseNumber<double>(split[1]);
+                std::string path = removePathQuotes(split[2]);
+                std::pair<double, double> offset = count < 3 ? std::pair<double, double>(parseNumber<int>(split[3]), parseNumber<int>(split[4])) : std::pair<double, double>(0, 0);
+                video = Video(starttime, path, offset);
+            }
+            break;
+            case Keyword::Sprite:
+            {
+                Layer layer = parseLayer(split[1]).value_or(Layer::Background);
+                Origin origin = parseOrigin(split[2]).value_or(Origin::Centre);
+                std::string path = removePathQuotes(split[3]);
+                float x = parseNumber<float>(split[4]);
+                float y = parseNumber<float>(split[5]);
+                addSource();
+                sprites.push_back(std::make_unique<Sprite>(layer, origin, path, std::pair<double, double>(x, y), arena));
+            }
+            break;
+            case Keyword::Animation:
+            {
+                Layer layer = parseLayer(split[1]).value_or(Layer::Background);
+                Origin origin = parseOrigin(split[2]).value_or(Origin::Centre);
+                std::string path = removePathQuotes(split[3]);
+                float x = parseNumber<float>(split[4]);
+                float y = parseNumber<float>(split[5]);
+                int frameCount = parseNumber<int>(split[6]);
+                double frameDelay = parseNumber<double>(split[7]);
+                LoopType loopType = parseLoopType(split[8]).value_or(LoopType::LoopForever);
+                addSource();
+                sprites.push_back(std::make_unique<class Animation>(layer, origin, path, std::pair<double, double>(x, y), frameCount, frameDelay, loopType, arena));
+            }
+            break;
+            case Keyword::Sample:
+            {
+                double time = parseNumber<double>(split[1]);
+                Layer layer = parseLayer(split[2]).value_or(Layer::Background);
+                std::string path = removePathQuotes(split[3]);
+                float volume = parseNumber<float>(split[4]);
+                samples.emplace_back(time, layer, path, volume);
+            }
+            break;
+            default:
+            {
+                if (sprites.empty()) break;
+                Sprite& sprite = **(sprites.end() - 1);
+                if (split[0] == "T")
+                {
+                    std::string triggerName = std::string(split[1]);
+                    double starttime = parseNumber<double>(split[2]);
+                    double endTime = parseNumber<double>(split[3]);
+                    int groupNumber = count > 4 ? parseNumber<int>(split[4]) : 0;
+                    sprite.AddTrigger({ triggerName, starttime, endTime, groupNumber });
+                    inTrigger = true;
+                    break;
+                }
+                if (split[0] == "L")
+                {
+                    double starttime = parseNumber<double>(split[1]);
+                    int loopCount = parseNumber<int>(split[2]);
+                    sprite.AddLoop({ starttime, loopCount });
+                    inLoop = true;
+                    break;
+                }
+
+                if (depth == 0) break;
+                if (split[3].length() == 0)
+                    split[3] = split[2];
+
+                Easing easing = static_cast<Easing>(parseNumber<int>(split[1]));
+                double starttime = parseNumber<double>(split[2]);
+                double endTime = parseNumber<double>(split[3]);
+
+
+                EventType eventType = parseEventType(split[0]);
+                auto addEvent = [&](auto startValue, auto endValue)
+                {
+                    if (inTrigger) sprite.AddEventInTrigger(eventType, easing, starttime, endTime, startValue, endValue);
+                    else if (inLoop) sprite.AddEventInLoop(eventType, easing, starttime, endTime, startValue, endValue);
+                    else sprite.AddEvent(eventType, easing, starttime, endTime, startValue, endValue);
+                };
+                switch (eventType)
+                {
+                case EventType::F:
+                case EventType::S:
+                case EventType::R:
+                case EventType::MX:
+                case EventType::MY:
+                {
+                    double startValue = parseNumber<double>(split[4]);
+                    double endValue = count > 5 ? parseNumber<double>(split[5]) : startValue;
+                    addEvent(startValue, endValue);
+                }
+                break;
+                case EventType::V:
+                case EventType::M:
+                {
+                    double startX = parseNumber<double>(split[4]);
+                    double startY = parseNumber<double>(split[5]);
+                    double endX = count > 6 ? parseNumber<double>(split[6]) : startX;
+                    double endY = count > 7 ? parseNumber<double>(split[7]) : startY;
+                    addEvent(std::pair<double, double>{ startX, startY }, std::pair<double, double>{ endX, endY });
+                }
+                break;
+                case EventType::C:
+                {
+                    int startR = parseNumber<int>(split[4]);
+                    int startG = parseNumber<int>(split[5]);
+                    int startB = parseNumber<int>(split[6]);
+                    int endR = count > 7 ? parseNumber<int>(split[7]) : startR;
+                    int endG = count > 8 ? parseNumber<int>(split[8]) : startG;
+                    int endB = count > 9 ? parseNumber<int>(split[9]) : startB;
+                    addEvent(Colour{ startR / 255.0f, startG / 255.0f, startB / 255.0f }, Colour{ endR / 255.0f, endG / 255.0f, endB / 255.0f });
+                }
+                break;
+                case EventType::P:
+                {
+                    std::optional<ParameterType> parameterType = parseParameterType(split[4]);
+                    if (!parameterType.has_value()) break;
+                    addEvent(*parameterType, *parameterType);
+                }
+                break;
+                case EventType::None:
+                    break;
+                }
+            }
+            break;
+            }
+        }
+        lineStart = data.size();
+        addSource();
+        return lineNumber;
+    }
+
+    // finds the start of the next top-level Sprite/Animation line at or after pos, which is where a chunk can be split off safely
+    std::size_t findObjectBoundary(std::string_view data, std::size_t pos)
+    {
+        while ((pos = data.find('\n', pos)) != std::string_view::npos)
+        {
+            std::string_view next = data.substr(++pos);
+            if (next.rfind("Sprite,", 0) == 0 || next.rfind("Animation,", 0) == 0) return pos;
+        }
+        return data.size();
+    }
+
+    // large sections are split at object boundaries and the chunks are parsed in parallel, then concatenated in file order
+    // so the resulting sprite order, and with it the draw order, is the same as a serial parse
+    std::size_t parseEventSection(std::string_view data, const Variables& variables, std::vector<std::unique_ptr<Sprite>>& sprites, std::vector<Sample>& samples, Background& background, Video& video, std::vector<std::string_view>* sources = nullptr)
+    {
+        constexpr std::size_t minChunkSize = 1 << 16;
+        const std::size_t threads = omp_get_max_threads();
+        const std::size_t chunkTarget = std::min(threads * 4, data.size() / minChunkSize);
+        if (threads < 2 || chunkTarget < 2)
+            return parseEvents(data, variables, sprites, samples, background, video, sources);
+
+        std::vector<std::size_t> boundaries = { 0 };
+        for (std::size_t i = 1; i < chunkTarget; i++)
+        {
+            std::size_t boundary = findObjectBoundary(data, std::max(data.size() * i / chunkTarget, boundaries.back()));
+            if (boundary >= data.size()) break;
+            boundaries.push_back(boundary);
+        }
+        boundaries.push_back(data.size());
+
+        struct Chunk
+        {
+            std::vector<std::unique_ptr<Sprite>> sprites;
+            std::vector<Sample> samples;
+            Background background;
+            Video video;
+            std::vector<std::string_view> sources;
+            std::size_t lineNumber = 0;
+            std::exception_ptr error;
+        };
+        std::vector<Chunk> chunks(boundaries.size() - 1);
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < (int)chunks.size(); i++)
+        {
+            Chunk& chunk = chunks[i];
+            try
+            {
+                chunk.lineNumber = parseEvents(data.substr(boundaries[i], boundaries[i + 1] - boundaries[i]), variables, chunk.sprites, chunk.samples, chunk.background, chunk.video, sources ? &chunk.sources : nullptr);
+            }
+            catch (...)
+            {
+                chunk.error = std::current_exception();
+            }
+        }
+
+        std::size_t lineNumber = 0;
+        std::size_t spriteCount = sprites.size();
+        for (const Chunk& chunk : chunks)
+        {
+            if (chunk.error) std::rethrow_exception(chunk.error);
+            spriteCount += chunk.sprites.size();
+        }
+        sprites.reserve(spriteCount);
+        for (Chunk& chunk : chunks)
+        {
+            std::move(chunk.sprites.begin(), chunk.sprites.end(), std::back_inserter(sprites));
+            if (sources) sources->insert(sources->end(), chunk.sources.begin(), chunk.sources.end());
+            for (Sample& sample : chunk.samples) samples.push_back(sample);
+            if (chunk.background.exists) background = chunk.background;
+            if (chunk.video.exists) video = chunk.video;
+            lineNumber += chunk.lineNumber;
+        }
+        return lineNumber;
+    }
+
+    Section parseSectionHeader(std::string_view line)
+    {
+        if (line.rfind("[Events]", 0) == 0) return Section::Events;
+        if (line.rfind("[Variables]", 0) == 0) return Section::Variables;
+        if (line.rfind("[General]", 0) == 0 || line.rfind("[Metadata]", 0) == 0 || line.rfind("[Difficulty]", 0) == 0) return Section::Info;
+        if (line.rfind("[TimingPoints]", 0) == 0) return Section::TimingPoints;
+        if (line.rfind("[HitObjects]", 0) == 0) return Section::HitObjects;
+        return Section::None;
+    }
+
+    // byte range of a section's body, i.e. everything after its header line up to the next header
+    struct SectionRange
+    {
+        Section section;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    // finds every section header without tokenizing anything, so sections can be parsed in any order or not at all
+    // anything before the first header is recorded as a Section::None range
+    std::vector<SectionRange> indexSections(std::string_view data)
+    {
+        std::vector<SectionRange> sections;
+        std::size_t header = data.substr(0, 1) == "[" ? 0 : data.find("\n[");
+        sections.push_back({ Section::None, 0, header == std::string_view::npos ? data.size() : header });
+        while (header != std::string_view::npos)
+        {
+            if (data[header] == '\n') header++;
+            std::size_t begin = data.find('\n', header);
+            begin = begin == std::string_view::npos ? data.size() : begin + 1;
+            std::size_t next = begin < data.size() ? data.find("\n[", begin - 1) : std::string_view::npos;
+            std::size_t end = next == std::string_view::npos ? data.size() : next + 1;
+            sections.back().end = std::min(sections.back().end, header);
+            sections.push_back({ parseSectionHeader(data.substr(header, begin - header)), begin, end });
+            header = next;
+        }
+        return sections;
+    }
+
+    std::size_t countLines(std::string_view data)
+    {
+        return std::count(data.begin(), data.end(), '\n') + (!data.empty() && data.back() != '\n');
+    }
+
+    // same grammar as above, but tokenized in place over a memory-mapped file, one section body at a time
+    // fields are string_views into the mapping, so a line costs no allocations unless it creates a sprite/event or needs variables applied
+    // the [Events] section is handed to parseEventSection as a whole
+    void parseSection(Section section, std::string_view data, size_t& lineNumber, Variables& variables, TimingPointIndex& timingPoints, std::vector<std::unique_ptr<Sprite>>& sprites, std::vector<Sample>& samples, std::vector<std::pair<double, HitSound>>& hitSounds, Background& background, Video& video, std::unordered_map<std::string, std::string>& info)
+    {
+        if (section == Section::Events)
+        {
+            lineNumber += parseEventSection(data, variables, sprites, samples, background, video);
+            return;
+        }
+        if (section == Section::None)
+        {
+            lineNumber += countLines(data);
+            return;
+        }
+
+        std::array<std::string_view, 16> split;
+        std::size_t pos = 0;
+        std::string_view line;
+        while (nextLine(data, pos, line))
+        {
+            lineNumber++;
+            if (line.length() == 0) continue;
+            if (line.rfind("//", 0) == 0) continue;
+
+            switch (section)
+            {
+            case Section::None:
+            case Section::Events:
+                continue;
+
+            case Section::Variables:
+            {
+                std::size_t splitPos = line.find('=');
+                if (splitPos == std::string_view::npos || splitPos == line.length() - 1) continue;
+                variables.Add(std::string(line.substr(0, splitPos)), std::string(line.substr(splitPos + 1)));
+            }
+            break;
+
+            case Section::Info:
+            {
+                std::size_t splitPos = line.find(':');
+                if (splitPos == std::string_view::npos || splitPos == line.length() - 1) continue;
+                std::string_view value = line.substr(splitPos + 1);
+                while (!value.empty() && std::isspace(static_cast<unsigned char>(value[0]))) value.remove_prefix(1);
+                info.insert_or_assign(std::string(line.substr(0, splitPos)), std::string(value));
+            }
+            break;
+            case Section::TimingPoints:
+            {
+                std::size_t count = splitView(line, ',', split);
+                ControlPoint controlPoint = ControlPoint(parseNumber<double>(split[0]), parseNumber<double>(split[1]));
+                if (count > 2) controlPoint.meter = parseNumber<int>(split[2]);
+                if (count > 3) controlPoint.sampleIndex = parseNumber<int>(split[3]);
+                if (count > 4) controlPoint.sampleSet = parseNumber<int>(split[4]);
+                if (count > 5) controlPoint.volume = parseNumber<int>(split[5]);
+                if (count > 6) controlPoint.uninherited = parseNumber<int>(split[6]) == 1;
+                if (count > 7) controlPoint.effects = parseNumber<int>(split[7]);
+                timingPoints.Add(controlPoint);
+            }
+            break;
+            case Section::HitObjects:
+            {
+                // all we care to obtain are pairs of timestamps and hitsound identifiers for resolving triggers
+                std::size_t count = splitView(line, ',', split);
+                if (count > 3)
+                {
+                    int type = parseNumber<int>(split[3]);
+                    if (type & 1 && count > 5) // hit circle
+                    {
+                        int time = parseNumber<int>(split[2]);
+                        std::array<std::string_view, 3> hitSample;
+                        bool hasSample = splitView(split[5], ':', hitSample) > 2;
+                        int normalSet = hasSample ? parseNumber<int>(hitSample[0]) : 0;
+                        int additionSet = hasSample ? parseNumber<int>(hitSample[1]) : 0;
+                        int additionFlag = parseNumber<int>(split[4]);
+                        int index = hasSample ? parseNumber<int>(hitSample[2]) : 0;
+                        hitSounds.emplace_back(std::pair<double, HitSound>{ time, HitSound(normalSet, additionSet, additionFlag, index) });
+                    }
+                    if (type & 2 && count > 10) // slider
+                    {
+                        double time = parseNumber<double>(split[2]);
+                        int slides = parseNumber<int>(split[6]);
+                        double length = parseNumber<double>(split[7]);
+                        double travelDuration = timingPoints.SliderTravelDuration(time, length);
+                        FieldReader edgeSounds(split[8], '|');
+                        FieldReader edgeSets(split[9], '|');
+                        for (int i = 0; i < slides + 1; i++)
+                        {
+                            std::string_view edgeSound;
+                            std::string_view edgeSet;
+                            std::array<std::string_view, 2> sets;
+                            bool hasSet = edgeSets.Next(edgeSet);
+                            if (hasSet) splitView(edgeSet, ':', sets);
+                            int normalSet = hasSet ? parseNumber<int>(sets[0]) : 0;
+                            int additionSet = hasSet ? parseNumber<int>(sets[1]) : 0;
+                            int additionFlag = edgeSounds.Next(edgeSound) ? parseNumber<int>(edgeSound) : 0;
+                            int index = 0;
+                            hitSounds.emplace_back(std::pair<double, HitSound>{ time + travelDuration * i, HitSound(normalSet, additionSet, additionFlag, index) });
+                        }
+                    }
+                }
+            }
+            break;
+            }
+        }
+        if (section == Section::Variables) variables.Compile();
+    }
+
+    // parses the sections of an indexed document in file order
+    // hit objects and timing points are only used to resolve HitSound triggers, so they're parsed in a separate pass (hitObjects = true)
+    // once the storyboard is known to need them
+    void parseSections(std::string_view data, const std::vector<SectionRange>& sections, bool hitObjects, size_t& lineNumber, Variables& variables, std::vector<std::unique_ptr<Sprite>>& sprites, std::vector<Sample>& samples, std::vector<std::pair<double, HitSound>>& hitSounds, Background& background, Video& video, std::unordered_map<std::string, std::string>& info)
+    {
+        TimingPointIndex timingPoints;
+        auto sliderMultiplier = info.find("SliderMultiplier");
+        if (hitObjects && sliderMultiplier != info.end()) timingPoints.SetSliderMultiplier(parseNumber<double>(sliderMultiplier->second));
+        for (const SectionRange& range : sections)
+        {
+            bool isHitObjectSection = range.section == Section::TimingPoints || range.section == Section::HitObjects;
+            if (isHitObjectSection != hitObjects) continue;
+            if (range.section != Section::None || range.begin != 0) lineNumber++; // header
+            parseSection(range.section, data.substr(range.begin, range.end - range.begin), lineNumber, variables, timingPoints, sprites, samples, hitSounds, background, video, info);
+        }
+        variables.Compile();
     }
 
-    void ParseStoryboard(const std::filesystem::path& directory, const std::string& osb, const std::string& diff,
+    // check for utf-8 bom, which is present when exported through storybrew
+    std::string_view stripBom(std::string_view data)
+    {
+        if (data.substr(0, 3) == "\xEF\xBB\xBF") data.remove_prefix(3);
+        return data;
+    }
+
+    void parseFile(std::string_view data, size_t& lineNumber, Variables& variables, std::vector<std::unique_ptr<Sprite>>& sprites, std::vector<Sample>& samples, std::vector<std::pair<double, HitSound>>& hitSounds, Background& background, Video& video, std::unordered_map<std::string, std::string>& info)
+    {
+        data = stripBom(data);
+        std::vector<SectionRange> sections = indexSections(data);
+        parseSections(data, sections, false, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
+        parseSections(data, sections, true, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
+    }
+
+    FileContents openDocument(const SongFolder& folder, const std::string& name)
+    {
+        FileContents contents = folder.Open(name);
+        if (!contents.IsOpen()) throw std::exception(("Failed to open " + std::filesystem::path(name).extension().string() + " file \"" + name + "\"").c_str());
+        return contents;
+    }
+
+    // parses a single .osu/.osb into the shared containers and returns the number of lines read
+    std::size_t parseDocument(const SongFolder& folder, const std::string& name, bool legacyParser, Variables& variables,
         std::vector<std::unique_ptr<Sprite>>& sprites,
         std::vector<Sample>& samples,
         std::vector<std::pair<double, HitSound>>& hitSounds,
@@ -431,23 +951,240 @@ namespace sb
         std::unordered_map<std::string, std::string>& info
     )
     {
-        std::ifstream osbFile(osb);
-        if (!osbFile.is_open()) throw std::exception(("Failed to open .osb file \"" + osb + "\"").c_str());
-        std::ifstream diffFile(std::filesystem::path(directory) / diff);
-        if (!diffFile.is_open()) throw std::exception(("Failed to open .osu file \"" + diff + "\"").c_str());
+        std::size_t lineNumber = 0;
+        if (legacyParser && !folder.IsArchive())
+        {
+            std::filesystem::path filepath = folder.GetPath() / name;
+            std::ifstream file(filepath);
+            if (!file.is_open()) throw std::exception(("Failed to open " + filepath.extension().string() + " file \"" + filepath.string() + "\"").c_str());
+            parseFile(file, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
+        }
+        else if (legacyParser)
+        {
+            std::istringstream file(std::string(openDocument(folder, name).GetView()));
+            parseFile(file, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
+        }
+        else
+        {
+            FileContents file = openDocument(folder, name);
+            parseFile(file.GetView(), lineNumber, variables, sprites, samples, hitSounds, background, video, info);
+        }
+        return lineNumber;
+    }
+
+    void FindStoryboardFiles(const SongFolder& folder, std::string& osb, std::string& diff)
+    {
+        std::vector<std::string> osbs = folder.GetFileNames(".osb");
+        if (osbs.empty())
+        {
+            throw std::exception("No .osb file found");
+        }
+        osb = osbs.front();
+        if (diff.empty())
+        {
+            std::vector<std::string> diffs = folder.GetFileNames(".osu");
+            if (!diffs.empty()) diff = diffs.front();
+        }
+        if (diff.empty())
+        {
+            throw std::exception("No difficulty file found");
+        }
+    }
+
+    void ParseStoryboard(const SongFolder& folder, const std::string& osb, const std::string& diff,
+        std::vector<std::unique_ptr<Sprite>>& sprites,
+        std::vector<Sample>& samples,
+        std::vector<std::pair<double, HitSound>>& hitSounds,
+        Background& background,
+        Video& video,
+        std::unordered_map<std::string, std::string>& info,
+        bool legacyParser = false
+    )
+    {
+        Variables variables;
+
+        if (legacyParser)
+        {
+            std::cout << "Parsing " << diff << "...\n";
+            std::size_t lineNumber = parseDocument(folder, diff, legacyParser, variables, sprites, samples, hitSounds, background, video, info);
+            std::cout << "Parsed " << lineNumber << " lines\n";
+
+            std::cout << "Parsing " << osb << "...\n";
+            lineNumber = parseDocument(folder, osb, legacyParser, variables, sprites, samples, hitSounds, background, video, info);
+            std::cout << "Parsed " << lineNumber << " lines\n";
+            return;
+        }
+
+        // both files are indexed up front and everything but hit objects/timing points is parsed in file order,
+        // the latter are only worth tokenizing if some sprite ended up with a HitSound trigger
+        const std::string* names[2] = { &diff, &osb };
+        FileContents files[2];
+        std::string_view data[2];
+        std::vector<SectionRange> sections[2];
+        for (int i = 0; i < 2; i++)
+        {
+            files[i] = openDocument(folder, *names[i]);
+            data[i] = stripBom(files[i].GetView());
+            sections[i] = indexSections(data[i]);
+
+            std::cout << "Parsing " << (i == 0 ? diff : osb) << "...\n";
+            std::size_t lineNumber = 0;
+            parseSections(data[i], sections[i], false, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
+            std::cout << "Parsed " << lineNumber << " lines\n";
+        }
 
+        bool needsHitSounds = std::any_of(sprites.begin(), sprites.end(), [](const std::unique_ptr<Sprite>& sprite) {
+            return sprite->HasHitSoundTrigger();
+            });
+        if (!needsHitSounds)
+        {
+            std::cout << "No HitSound triggers, skipping hit objects\n";
+            return;
+        }
         std::size_t lineNumber = 0;
-        std::unordered_map<std::string, std::string> variables;
+        for (int i = 0; i < 2; i++)
+            parseSections(data[i], sections[i], true, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
+        std::cout << "Parsed " << lineNumber << " lines of hit objects (" << hitSounds.size() << " hitsounds)\n";
+    }
+
+    // a .osb parsed once and shared by every difficulty of a set
+    // sprites with HitSound triggers depend on the difficulty's hit objects, so for those only the source text is kept
+    // (sprites[i] is null and sources[i] holds its lines) and they're parsed again for each difficulty
+    struct SharedOsb
+    {
+        FileContents file;
+        std::string_view data;
+        std::vector<SectionRange> sections;
+        Variables variables;
+        std::vector<std::shared_ptr<Sprite>> sprites;
+        std::vector<std::string_view> sources;
+        std::vector<Sample> samples;
+        Background background;
+        Video video;
+        std::unordered_map<std::string, std::string> info;
+    };
+
+    void ParseSharedOsb(const SongFolder& folder, const std::string& osb, SharedOsb& shared)
+    {
+        shared.file = openDocument(folder, osb);
+        shared.data = stripBom(shared.file.GetView());
+        shared.sections = indexSections(shared.data);
 
+        std::cout << "Parsing " << osb << "...\n";
+        std::size_t lineNumber = 0;
+        std::vector<std::unique_ptr<Sprite>> sprites;
+        std::vector<std::string_view> sources;
+        std::vector<std::pair<double, HitSound>> hitSounds;
+        TimingPointIndex timingPoints;
+        for (const SectionRange& range : shared.sections)
+        {
+            if (range.section == Section::TimingPoints || range.section == Section::HitObjects) continue;
+            if (range.section != Section::None || range.begin != 0) lineNumber++;
+            std::string_view body = shared.data.substr(range.begin, range.end - range.begin);
+            if (range.section == Section::Events)
+                lineNumber += parseEventSection(body, shared.variables, sprites, shared.samples, shared.background, shared.video, &sources);
+            else
+                parseSection(range.section, body, lineNumber, shared.variables, timingPoints, sprites, shared.samples, hitSounds, shared.background, shared.video, shared.info);
+        }
+        shared.variables.Compile();
+        std::cout << "Parsed " << lineNumber << " lines\n";
+
+        shared.sprites.reserve(sprites.size());
+        shared.sources.resize(sprites.size());
+        for (std::size_t i = 0; i < sprites.size(); i++)
+        {
+            if (sprites[i]->HasHitSoundTrigger()) shared.sources[i] = sources[i];
+            shared.sprites.emplace_back(sprites[i]->HasHitSoundTrigger() ? nullptr : std::move(sprites[i]));
+        }
+    }
+
+    // same result as ParseStoryboard, but the .osb part comes from a SharedOsb, with its difficulty-independent sprites reused as they are
+    // returns false without parsing anything if the difficulty has [Variables], as those would change how the .osb is parsed
+    bool ParseStoryboard(const SongFolder& folder, const SharedOsb& osb, const std::string& diff,
+        std::vector<std::shared_ptr<Sprite>>& sprites,
+        std::vector<Sample>& samples,
+        std::vector<std::pair<double, HitSound>>& hitSounds,
+        Background& background,
+        Video& video,
+        std::unordered_map<std::string, std::string>& info
+    )
+    {
+        FileContents file = openDocument(folder, diff);
+        std::string_view data = stripBom(file.GetView());
+        std::vector<SectionRange> sections = indexSections(data);
+        for (const SectionRange& range : sections)
+            if (range.section == Section::Variables) return false;
+
+        Variables variables;
+        std::vector<std::unique_ptr<Sprite>> parsed;
         std::cout << "Parsing " << diff << "...\n";
-        parseFile(diffFile, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
-        diffFile.close();
+        std::size_t lineNumber = 0;
+        parseSections(data, sections, false, lineNumber, variables, parsed, samples, hitSounds, background, video, info);
         std::cout << "Parsed " << lineNumber << " lines\n";
+        std::move(parsed.begin(), parsed.end(), std::back_inserter(sprites));
+
+        // the .osb comes after the difficulty, so its sprites, samples and settings go on top
+        std::size_t reparsed = 0;
+        for (std::size_t i = 0; i < osb.sprites.size(); i++)
+        {
+            if (osb.sprites[i])
+            {
+                sprites.push_back(osb.sprites[i]);
+                continue;
+            }
+            std::vector<Sample> ignoredSamples;
+            Background ignoredBackground;
+            Video ignoredVideo;
+            parsed.clear();
+            parseEvents(osb.sources[i], osb.variables, parsed, ignoredSamples, ignoredBackground, ignoredVideo);
+            std::move(parsed.begin(), parsed.end(), std::back_inserter(sprites));
+            reparsed++;
+        }
+        for (const Sample& sample : osb.samples) samples.push_back(sample);
+        if (osb.background.exists) background = osb.background;
+        if (osb.video.exists) video = osb.video;
+        for (const std::pair<const std::string, std::string>& e : osb.info)
+            info.insert_or_assign(e.first, e.second);
+        std::cout << "Reused " << osb.sprites.size() - reparsed << " sprites from the .osb, reparsed " << reparsed << " with HitSound triggers\n";
 
+        bool needsHitSounds = std::any_of(sprites.begin(), sprites.end(), [](const std::shared_ptr<Sprite>& sprite) {
+            return sprite->HasHitSoundTrigger();
+            });
+        if (!needsHitSounds) return true;
         lineNumber = 0;
-        std::cout << "Parsing " << osb << "...\n";
-        parseFile(osbFile, lineNumber, variables, sprites, samples, hitSounds, background, video, info);
-        osbFile.close();
-        std::cout << "Parsed " << lineNumber << " lines\n";
+        parsed.clear();
+        parseSections(data, sections, true, lineNumber, variables, parsed, samples, hitSounds, background, video, info);
+        parseSections(osb.data, osb.sections, true, lineNumber, variables, parsed, samples, hitSounds, background, video, info);
+        std::cout << "Parsed " << lineNumber << " lines of hit objects (" << hitSounds.size() << " hitsounds)\n";
+        return true;
+    }
+
+    // parses the storyboard with both parsers and reports their throughput
+    void BenchmarkParser(const SongFolder& folder, const std::string& osb, const std::string& diff, int iterations = 3)
+    {
+        for (const bool legacyParser : { true, false })
+        {
+            double best = std::numeric_limits<double>::max();
+            std::size_t lines = 0;
+            std::size_t spriteCount = 0;
+            for (int i = 0; i < iterations; i++)
+            {
+                std::vector<std::unique_ptr<Sprite>> sprites;
+                std::vector<Sample> samples;
+                std::vector<std::pair<double, HitSound>> hitSounds;
+                Background background;
+                Video video;
+                std::unordered_map<std::string, std::string> info;
+                Variables variables;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                lines = parseDocument(folder, diff, legacyParser, variables, sprites, samples, hitSounds, background, video, info);
+                lines += parseDocument(folder, osb, legacyParser, variables, sprites, samples, hitSounds, background, video, info);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count());
+                spriteCount = sprites.size();
+            }
+            std::cout << (legacyParser ? "legacy" : "mapped") << " parser: " << lines << " lines, " << spriteCount << " sprites, "
+                << best * 1000 << " ms (" << (std::size_t)(lines / best) << " lines/s)\n";
+        }
     }
 }
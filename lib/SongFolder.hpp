@@ -0,0 +1,169 @@
+#pragma once
+
+#include <Archive.hpp>
+#include <MappedFile.hpp>
+#include <Helpers.hpp>
+#include <ImageReader.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <exception>
+
+namespace sb
+{
+    // contents of a file in a SongFolder: mapped from disk, a view of a stored archive member, or an inflated copy of a deflated one
+    class FileContents
+    {
+    public:
+        FileContents() = default;
+        FileContents(MappedFile file)
+            :
+            file(std::move(file))
+        {
+            view = this->file.GetView();
+            open = this->file.IsOpen();
+        }
+        bool IsOpen() const
+        {
+            return open;
+        }
+        std::string_view GetView() const
+        {
+            return owned ? std::string_view(buffer) : view;
+        }
+    private:
+        friend class SongFolder;
+        MappedFile file;
+        std::string buffer;
+        std::string_view view;
+        bool owned = false;
+        bool open = false;
+    };
+
+    // a song folder, either a directory or an .osz archive read in place
+    // ffmpeg, ffprobe and cv::VideoCapture need real files, so audio/video members of an archive are extracted to a temporary directory on request
+    class SongFolder
+    {
+    public:
+        explicit SongFolder(const std::filesystem::path& path)
+            :
+            path(path)
+        {
+            if (!std::filesystem::is_regular_file(path)) return;
+            archive = Archive(path);
+            if (!archive.IsOpen()) throw std::exception(("Failed to open archive \"" + path.string() + "\"").c_str());
+            isArchive = true;
+        }
+        SongFolder(const SongFolder&) = delete;
+        SongFolder& operator=(const SongFolder&) = delete;
+        ~SongFolder()
+        {
+            if (!extractDirectory.empty())
+            {
+                std::error_code error;
+                std::filesystem::remove_all(extractDirectory, error);
+            }
+        }
+        bool IsArchive() const
+        {
+            return isArchive;
+        }
+        const std::filesystem::path& GetPath() const
+        {
+            return path;
+        }
+        // names of the files at the top level with the given extension
+        std::vector<std::string> GetFileNames(const std::string& extension) const
+        {
+            std::vector<std::string> names;
+            if (isArchive)
+            {
+                for (const std::string& name : archive.GetNames())
+                    if (name.find_first_of("/\\") == std::string::npos && std::filesystem::path(name).extension() == extension)
+                        names.push_back(name);
+            }
+            else
+            {
+                for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(path))
+                    if (entry.path().extension() == extension)
+                        names.push_back(entry.path().filename().string());
+            }
+            return names;
+        }
+        FileContents Open(const std::string& name) const
+        {
+            if (!isArchive) return FileContents(MappedFile(path / name));
+            FileContents contents;
+            std::string_view data;
+            contents.open = archive.Read(name, contents.buffer, data);
+            contents.owned = contents.open && !contents.buffer.empty();
+            contents.view = contents.owned ? std::string_view() : data;
+            return contents;
+        }
+        // same as readImageFile on the file in the folder, decoded straight from the archive if there is one
+        cv::Mat ReadImage(const std::string& name) const
+        {
+            if (!isArchive) return readImageFile((path / name).generic_string());
+            FileContents contents = Open(name);
+            return convertImage(readImage(contents.IsOpen() ? contents.GetView() : std::string_view(), name));
+        }
+        // path of the file on disk, extracting it first if it's in an archive
+        // not thread-safe; only used for the few files that external tools open
+        std::string GetLocalPath(const std::string& name) const
+        {
+            if (!isArchive) return (path / name).generic_string();
+            std::string normalised = Archive::NormaliseName(name);
+            auto k = extracted.find(normalised);
+            if (k != extracted.end()) return k->second;
+            if (extractDirectory.empty())
+                extractDirectory = std::filesystem::temp_directory_path() / ("osb2mp4-" + path.stem().string() + "-" + std::to_string(std::random_device()()));
+            // names come from the storyboard and the archive, so one reaching outside the extraction directory is never written,
+            // and is treated like a file the archive doesn't have
+            std::filesystem::path destination = (extractDirectory / normalised).lexically_normal();
+            if (!isContainedName(normalised) || !isContainedName(destination.lexically_relative(extractDirectory)))
+            {
+                std::cerr << "Not extracting \"" << name << "\", which points outside the archive\n";
+                return extracted.emplace(normalised, std::string()).first->second;
+            }
+            FileContents contents = Open(name);
+            if (contents.IsOpen())
+            {
+                std::error_code error;
+                std::filesystem::create_directories(destination.parent_path(), error);
+                std::ofstream file(destination, std::ios::binary);
+                std::string_view data = contents.GetView();
+                file.write(data.data(), data.size());
+                if (!file.good()) std::cerr << "Could not extract \"" << name << "\" to \"" << destination.string() << "\"\n";
+            }
+            return extracted.emplace(normalised, destination.generic_string()).first->second;
+        }
+        // the parsed storyboard cache lives next to the difficulty, or next to the archive
+        std::filesystem::path GetCacheFile(const std::string& diff) const
+        {
+            std::string name = std::filesystem::path(diff).stem().string() + ".osbc";
+            if (!isArchive) return path / name;
+            return path.parent_path() / (path.stem().string() + " - " + name);
+        }
+    private:
+        // relative, without a drive, and without any ".." in it
+        static bool isContainedName(const std::filesystem::path& name)
+        {
+            if (name.empty() || name.has_root_name() || name.has_root_directory()) return false;
+            for (const std::filesystem::path& part : name)
+                if (part == "..") return false;
+            return true;
+        }
+        std::filesystem::path path;
+        Archive archive;
+        bool isArchive = false;
+        mutable std::filesystem::path extractDirectory;
+        mutable std::unordered_map<std::string, std::string> extracted;
+    };
+}
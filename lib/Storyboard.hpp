@@ -2,6 +2,8 @@
 
 #include <Components.hpp>
 #include <Parser.hpp>
+#include <Cache.hpp>
+#include <SongFolder.hpp>
 
 #include <opencv2/opencv.hpp>
 #include <iostream>
@@ -12,15 +14,104 @@
 #include <vector>
 #include <memory>
 #include <exception>
+#include <chrono>
+#include <omp.h>
 
 namespace sb
 {
+    // what the Storyboards of every difficulty in a set can share when they're rendered in one go:
+    // the parsed .osb and the decoded sprite images
+    struct SharedStoryboard
+    {
+        SharedStoryboard(const SongFolder& folder)
+        {
+            std::string diff;
+            FindStoryboardFiles(folder, osbPath, diff);
+            ParseSharedOsb(folder, osbPath, osb);
+        }
+        std::string osbPath;
+        SharedOsb osb;
+        std::unordered_map<std::string, cv::Mat> spriteImages;
+    };
+
+    // the sprites drawn in one frame, evaluated before any of them is rasterised and kept one array per property,
+    // so that the quads of all of them can be worked out in one plain loop
+    struct SpriteBatch
+    {
+        enum Flags : std::uint8_t
+        {
+            FlipH = 1,
+            FlipV = 2,
+            Additive = 4
+        };
+        void Clear()
+        {
+            for (std::vector<float>* v : { &x, &y, &width, &height, &rotation, &r, &g, &b, &alpha, &originX, &originY })
+                v->clear();
+            flags.clear();
+            texture.clear();
+            quads.clear();
+        }
+        std::size_t Size() const
+        {
+            return texture.size();
+        }
+        // corners of each sprite's quad in frame space, in the order RasteriseQuad maps the image onto: bottom left, top left, top right,
+        // bottom right, then swapped around for flipped sprites
+        void ComputeQuads(float frameScale, float xOffset)
+        {
+            static const int order[4][4] = { { 0, 1, 2, 3 }, { 3, 2, 1, 0 }, { 1, 0, 3, 2 }, { 2, 3, 0, 1 } };
+            quads.resize(Size() * 4);
+            for (std::size_t i = 0; i < Size(); i++)
+            {
+                // the origin is measured on the size cut to whole pixels
+                float w = (float)(int)width[i];
+                float h = (float)(int)height[i];
+                float ox = w * originX[i];
+                float oy = h * originY[i];
+                float cosine = std::cos(rotation[i]);
+                float sine = std::sin(rotation[i]);
+                // the sprite's centre, rotated about its origin
+                float dx = w * 0.5f - ox;
+                float dy = h * 0.5f - oy;
+                float cx = x[i] * frameScale + dx * cosine - dy * sine + xOffset;
+                float cy = y[i] * frameScale + dy * cosine + dx * sine;
+                // same as cv::RotatedRect::points
+                float a = sine * 0.5f;
+                float c = cosine * 0.5f;
+                cv::Point2f corners[4];
+                corners[0] = cv::Point2f(cx - a * height[i] - c * width[i], cy + c * height[i] - a * width[i]);
+                corners[1] = cv::Point2f(cx + a * height[i] - c * width[i], cy - c * height[i] - a * width[i]);
+                corners[2] = cv::Point2f(2 * cx - corners[0].x, 2 * cy - corners[0].y);
+                corners[3] = cv::Point2f(2 * cx - corners[1].x, 2 * cy - corners[1].y);
+                const int* o = order[flags[i] & (FlipH | FlipV)];
+                for (int k = 0; k < 4; k++) quads[i * 4 + k] = corners[o[k]];
+            }
+        }
+        std::vector<float> x;
+        std::vector<float> y;
+        // size in frame pixels
+        std::vector<float> width;
+        std::vector<float> height;
+        std::vector<float> rotation;
+        std::vector<float> r;
+        std::vector<float> g;
+        std::vector<float> b;
+        std::vector<float> alpha;
+        // where the origin is, as a fraction of the size
+        std::vector<float> originX;
+        std::vector<float> originY;
+        std::vector<std::uint8_t> flags;
+        std::vector<std::uint32_t> texture;
+        std::vector<cv::Point2f> quads;
+    };
+
     class Storyboard
     {
     public:
-        Storyboard(const std::filesystem::path& directory, const std::string& diff, std::pair<unsigned, unsigned> resolution, float musicVolume, float effectVolume, float dim, bool useStoryboardAspectRatio, bool showFailLayer, float zoom = 1)
+        Storyboard(const SongFolder& folder, const std::string& diff, std::pair<unsigned, unsigned> resolution, float musicVolume, float effectVolume, float dim, bool useStoryboardAspectRatio, bool showFailLayer, float zoom = 1, bool legacyParser = false, bool useCache = true, SharedStoryboard* shared = nullptr, double linearisationError = 0, bool compactKeyframes = false, bool easingTables = false)
             :
-            directory(directory),
+            folder(folder),
             diff(diff),
             resolution(resolution),
             musicVolume(musicVolume),
@@ -28,38 +119,35 @@ namespace sb
             dim(dim),
             showFailLayer(showFailLayer),
             frameScale(resolution.second / 480.0),
-            zoom(zoom)
+            zoom(zoom),
+            easingTables(easingTables)
         {
-            for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+            FindStoryboardFiles(folder, osb, this->diff);
+            // everything only needed to get to the baked render sprites goes away with the constructor
+            std::vector<std::shared_ptr<Sprite>> sprites;
+            std::vector<std::pair<double, HitSound>> hitSounds;
+
+            // parsed and initialised sprites are cached next to the difficulty, keyed by the contents of both files
+            std::filesystem::path cacheFile = folder.GetCacheFile(this->diff);
+            std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
+            std::uint64_t cacheKey = useCache ? StoryboardCacheKey(openDocument(folder, this->diff).GetView(), openDocument(folder, osb).GetView()) : 0;
+            bool cached = useCache && LoadStoryboardCache(cacheFile, cacheKey, sprites, samples, background, video, info, audioDuration, sampleDurations);
+            if (cached)
+                std::cout << "Loaded storyboard cache (" << sprites.size() << " sprites, " << samples.size() << " samples)" << "\n";
+            else
             {
-                if (entry.path().extension() == ".osb")
+                if (shared == nullptr || legacyParser || !ParseStoryboard(folder, shared->osb, this->diff, sprites, samples, hitSounds, background, video, info))
                 {
-                    osb = entry.path().string();
-                    break;
+                    std::vector<std::unique_ptr<Sprite>> parsed;
+                    ParseStoryboard(folder, osb, this->diff, parsed, samples, hitSounds, background, video, info, legacyParser);
+                    std::move(parsed.begin(), parsed.end(), std::back_inserter(sprites));
                 }
-            }
-            if (osb.empty())
-            {
-                throw std::exception("No .osb file found");
-            }
-            if (this->diff.empty())
-                for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
-                {
-                    if (entry.path().extension() == ".osu")
-                    {
-                        this->diff = entry.path().filename().string();
-                        break;
-                    }
-                }
-            if (this->diff.empty())
-            {
-                throw std::exception("No difficulty file found");
-            }
-            ParseStoryboard(directory, osb, this->diff, sprites, samples, hitSounds, background, video, info);
 
-            std::stable_sort(sprites.begin(), sprites.end(), [](const auto &a, const auto &b) {
-                return a->GetLayer() < b->GetLayer();
-                });
+                std::stable_sort(sprites.begin(), sprites.end(), [](const auto &a, const auto &b) {
+                    return a->GetLayer() < b->GetLayer();
+                    });
+            }
+            std::cout << (cached ? "Loaded" : "Parsed") << " in " << millisecondsSince(phaseStart) << " ms\n";
 
             auto wdsb = info.find("WidescreenStoryboard");
             bool widescreenStoryboard = wdsb != info.end() && std::stoi(wdsb->second) != 0;
@@ -68,13 +156,40 @@ namespace sb
 
             xOffset = (this->resolution.first - this->resolution.second / 3.0 * 4) * 0.5;
 
-            std::cout << "Initialising storyboard (" << sprites.size() << " sprites, " << samples.size() << " samples)" << "\n";
-            for (std::unique_ptr<Sprite>& sprite : sprites)
-                sprite->Initialise(hitSounds);
+            if (!cached)
+            {
+                std::cout << "Initialising storyboard (" << sprites.size() << " sprites, " << samples.size() << " samples)" << "\n";
+                phaseStart = std::chrono::steady_clock::now();
+                // sprites only read the hitsound index and write their own state, so each one can be initialised on any thread and the result doesn't depend on the schedule
+                // sprites reused from a shared .osb were already initialised by an earlier difficulty
+                HitSoundIndex hitSoundIndex(hitSounds);
+                std::exception_ptr error;
+                std::size_t keyframeCount = 0;
+                std::size_t removedKeyframes = 0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+: keyframeCount, removedKeyframes)
+                for (int i = 0; i < (int)sprites.size(); i++)
+                {
+                    if (sprites[i]->IsInitialised()) continue;
+                    try
+                    {
+                        sprites[i]->Initialise(hitSoundIndex);
+                        keyframeCount += sprites[i]->GetKeyframes().Count();
+                        removedKeyframes += sprites[i]->SimplifyKeyframes();
+                    }
+                    catch (...)
+                    {
+#pragma omp critical
+                        if (!error) error = std::current_exception();
+                    }
+                }
+                if (error) std::rethrow_exception(error);
+                std::cout << "Initialised sprites in " << millisecondsSince(phaseStart) << " ms (" << omp_get_max_threads() << " threads)\n";
+                std::cout << "Simplified keyframes from " << keyframeCount << " to " << keyframeCount - removedKeyframes << "\n";
+            }
             std::pair<double, double> activetime = { std::numeric_limits<int>::max(), std::numeric_limits<int>::min() };
 
             bool backgroundIsASprite = false;
-            for (const std::unique_ptr<Sprite>& sprite : sprites)
+            for (const std::shared_ptr<Sprite>& sprite : sprites)
             {
                 std::pair<double, double> at = sprite->GetVisibleTime();
                 activetime.first = std::min(activetime.first, at.first);
@@ -84,18 +199,48 @@ namespace sb
             }
             this->activetime = activetime;
             auto k = info.find("AudioFilename");
-            if (k != info.end()) this->audioDuration = 1000 * getAudioDuration((directory / k->second).generic_string());
-            else this->audioDuration = 0;
+            if (!cached)
+            {
+                phaseStart = std::chrono::steady_clock::now();
+                if (k != info.end()) this->audioDuration = 1000 * getAudioDuration(folder.GetLocalPath(k->second));
+                else this->audioDuration = 0;
+                for (const Sample& sample : samples)
+                    if (sampleDurations.find(sample.filepath) == sampleDurations.end())
+                        sampleDurations.emplace(sample.filepath, getAudioDuration(folder.GetLocalPath(sample.filepath)));
+                std::cout << "Probed " << sampleDurations.size() + (k != info.end()) << " audio files in " << millisecondsSince(phaseStart) << " ms\n";
+            }
             auto l = info.find("AudioLeadIn");
             if (k != info.end() && l != info.end()) this->audioLeadIn = std::stoi(l->second);
             else this->audioLeadIn = 0;
             std::cout << "Initialised " << sprites.size() << " sprites/animations\n";
+            if (useCache && !cached)
+                SaveStoryboardCache(cacheFile, cacheKey, sprites, samples, background, video, info, audioDuration, sampleDurations);
+
+            // sprites on the layer that isn't shown, or whose opacity or scale is zero whenever they're active, are never drawn,
+            // so they're dropped before their images are loaded. the rest only need looking at while they may be seen
+            phaseStart = std::chrono::steady_clock::now();
+            std::vector<std::vector<std::pair<double, double>>> visibleSpans(sprites.size());
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int i = 0; i < (int)sprites.size(); i++)
+                if (sprites[i]->GetLayer() != (showFailLayer ? Layer::Pass : Layer::Fail))
+                    visibleSpans[i] = sprites[i]->GetKeyframes().VisibleSpans(sprites[i]->GetActiveTime());
+            std::size_t shownSprites = 0;
+            for (std::size_t i = 0; i < sprites.size(); i++)
+            {
+                if (visibleSpans[i].empty()) continue;
+                sprites[shownSprites] = std::move(sprites[i]);
+                visibleSpans[shownSprites] = std::move(visibleSpans[i]);
+                shownSprites++;
+            }
+            std::cout << "Dropped " << sprites.size() - shownSprites << " sprites that are never drawn in " << millisecondsSince(phaseStart) << " ms\n";
+            sprites.resize(shownSprites);
+            visibleSpans.resize(shownSprites);
 
             blankImage = cv::Mat::zeros(this->resolution.second, this->resolution.first, CV_8UC3);
             backgroundImage = cv::Mat::zeros(this->resolution.second, this->resolution.first, CV_8UC3);
             if (background.exists && !backgroundIsASprite)
             {
-                cv::Mat image = readImageFile((directory / background.filepath).generic_string());
+                cv::Mat image = folder.ReadImage(background.filepath);
                 cv::RotatedRect quadRect = cv::RotatedRect(
                     cv::Point2f(
                         this->resolution.first / 2.0f + background.offset.first * frameScale,
@@ -109,19 +254,109 @@ namespace sb
                 RasteriseQuad(backgroundImage.begin<cv::Vec<uint8_t, 3>>(), image.begin<cv::Vec<float, 4>>(), image.cols, image.rows, quad, Colour(1, 1, 1), false, 1);
             }
 
-            if (video.exists && !(videoOpen = videoCap.open((directory / video.filepath).generic_string()))) videoCap.release();
+            if (video.exists && !(videoOpen = videoCap.open(folder.GetLocalPath(video.filepath)))) videoCap.release();
 
             std::cout << "Loading images..." << std::endl;
-            for (const std::unique_ptr<Sprite>& sprite : sprites)
+            phaseStart = std::chrono::steady_clock::now();
+            std::unordered_map<std::string, std::uint32_t> textureIndices;
+            for (const std::shared_ptr<Sprite>& sprite : sprites)
             {
                 std::vector<std::string> filePaths = sprite->GetFilePaths();
                 for (std::string filePath : filePaths)
                 {
-                    if (spriteImages.find(filePath) != spriteImages.end()) continue;
-                    cv::Mat image = readImageFile((directory / filePath).generic_string());
-                    auto ret = spriteImages.emplace(filePath, image);
+                    if (textureIndices.find(filePath) != textureIndices.end()) continue;
+                    textureIndices.emplace(filePath, (std::uint32_t)textures.size());
+                    if (shared)
+                    {
+                        // cv::Mat copies share their pixels, so every difficulty draws from the same decoded image
+                        auto k = shared->spriteImages.find(filePath);
+                        if (k != shared->spriteImages.end())
+                        {
+                            textures.push_back(k->second);
+                            continue;
+                        }
+                    }
+                    cv::Mat image = folder.ReadImage(filePath);
+                    textures.push_back(image);
+                    if (shared) shared->spriteImages.emplace(filePath, image);
                 }
             }
+            std::cout << "Loaded " << textures.size() << " images in " << millisecondsSince(phaseStart) << " ms\n";
+
+            // linearising, interning and compacting rewrite the keyframes for this rendering only, so they work on copies of them:
+            // the sprites of a shared .osb are cached again by every later difficulty, and rendering options mustn't reach the cache.
+            // copying a track only copies its handle, not its keyframes
+            std::vector<SpriteKeyframes> keyframes;
+            keyframes.reserve(sprites.size());
+            for (const std::shared_ptr<Sprite>& sprite : sprites)
+                keyframes.push_back(sprite->GetKeyframes());
+
+            // the error bound depends on the output resolution
+            if (linearisationError > 0)
+            {
+                phaseStart = std::chrono::steady_clock::now();
+                std::size_t linearised = 0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+: linearised)
+                for (int i = 0; i < (int)sprites.size(); i++)
+                {
+                    double size = 0;
+                    for (const std::string& filePath : sprites[i]->GetFilePaths())
+                    {
+                        const cv::Mat& image = textures[textureIndices.at(filePath)];
+                        size = std::max({ size, (double)image.cols, (double)image.rows });
+                    }
+                    linearised += keyframes[i].Linearise(linearisationError / zoom, frameScale, size * frameScale, sprites[i]->GetOrigin());
+                }
+                std::cout << "Linearised " << linearised << " eased segments in " << millisecondsSince(phaseStart) << " ms\n";
+            }
+
+            // particle effects tend to be many sprites with the same keyframes, often just starting at different times, which only need to be kept once
+            phaseStart = std::chrono::steady_clock::now();
+            SpriteTrackPools pools;
+            for (SpriteKeyframes& spriteKeyframes : keyframes)
+                spriteKeyframes.Intern(pools);
+            std::cout << "Shared " << pools.TrackCount() << " tracks as " << pools.UniqueTrackCount() << " (" << pools.KeyframeCount() << " keyframes as "
+                << pools.UniqueKeyframeCount() << ") in " << millisecondsSince(phaseStart) << " ms\n";
+            if (compactKeyframes)
+            {
+                phaseStart = std::chrono::steady_clock::now();
+                for (SpriteKeyframes& spriteKeyframes : keyframes)
+                    spriteKeyframes.Compact(pools);
+                std::cout << "Compacted keyframes from " << pools.Bytes() / 1024 << " to " << pools.CompactBytes() / 1024 << " KiB in " << millisecondsSince(phaseStart) << " ms\n";
+            }
+
+
+            // drawing only needs the keyframes and images, not the commands and file names they came from.
+            // sprites none of whose images could be read draw nothing either
+            phaseStart = std::chrono::steady_clock::now();
+            renderSprites.reserve(sprites.size());
+            std::size_t bakedSprites = 0;
+            for (std::size_t i = 0; i < sprites.size(); i++)
+            {
+                std::vector<std::string> filePaths = sprites[i]->GetFilePaths();
+                if (std::any_of(filePaths.begin(), filePaths.end(), [&](const std::string& filePath) { return !textures[textureIndices.at(filePath)].empty(); }))
+                {
+                    renderSprites.push_back(sprites[i]->Bake((std::uint32_t)frames.size(), renderTracks.Add(keyframes[i])));
+                    for (const std::string& filePath : filePaths)
+                        frames.push_back(textureIndices.at(filePath));
+                    visibleSpans[bakedSprites++] = std::move(visibleSpans[i]);
+                }
+                // sprites of a shared .osb live on in it for the next difficulty
+                sprites[i].reset();
+                keyframes[i] = SpriteKeyframes();
+            }
+            renderTracks.Finish();
+            visibleSpans.resize(bakedSprites);
+            std::cout << "Baked " << renderSprites.size() << " render sprites (" << sprites.size() - renderSprites.size() << " without images) into "
+                << renderSprites.size() * sizeof(RenderSprite) / 1024 << " KiB, sharing " << renderTracks.Size() << " tracks, in " << millisecondsSince(phaseStart) << " ms\n";
+
+            // each frame then only looks at the sprites of one bucket instead of all of them
+            activeSprites = ActiveSpriteIndex(visibleSpans);
+            std::cout << "Indexed active sprites in " << activeSprites.BucketCount() << " buckets (" << activeSprites.Size() << " entries)\n";
+
+            cursors.assign(omp_get_max_threads(), std::vector<SpriteCursor>(renderSprites.size()));
+            std::cout << "Keeping " << cursors.size() * renderSprites.size() * sizeof(SpriteCursor) / 1024 << " KiB of keyframe cursors for " << cursors.size() << " threads\n";
+            batches.resize(omp_get_max_threads());
         }
         std::pair<unsigned, unsigned> GetResolution() const
         {
@@ -145,7 +380,7 @@ namespace sb
             std::vector<int> indices;
             std::string command = "ffmpeg -y -hide_banner -v error -stats";
             auto k = info.find("AudioFilename");
-            if (k != info.end()) command += " -i \"" + (directory / k->second).generic_string() + "\"";
+            if (k != info.end()) command += " -i \"" + folder.GetLocalPath(k->second) + "\"";
             std::vector<int> delays;
             std::vector<double> volumes;
             volumes.push_back((samples.size() + 1) * musicVolume);
@@ -160,7 +395,7 @@ namespace sb
             int totalSamples = samples.size();
             for (const Sample& sample : samples)
             {
-                std::string filepath = (directory / sample.filepath).generic_string();
+                std::string filepath = folder.GetLocalPath(sample.filepath);
                 auto ret = sampleIndices.emplace(filepath, unique);
                 indices.push_back(ret.first->second);
                 int delay = (int)sample.starttime;
@@ -171,7 +406,7 @@ namespace sb
                 if (ret.second)
                 {
                     command += " -i \"" + filepath + "\"";
-                    maxDuration = std::max(maxDuration, getAudioDuration((directory / sample.filepath).generic_string()));
+                    maxDuration = std::max(maxDuration, sampleDurations.at(sample.filepath));
                     unique++;
                     count = 0;
                 }
@@ -199,79 +434,76 @@ namespace sb
         {
             cv::Mat frame = video.exists ? GetVideoImage(time) : backgroundImage.clone();
             cv::MatIterator_<cv::Vec<uint8_t, 3>> frameStart = frame.begin<cv::Vec<cv::uint8_t, 3>>();
-            for (const std::unique_ptr<Sprite>& sprite : sprites)
+            // frames are handed out to threads in order, so each thread's cursors only ever have to move a little forward
+            std::vector<SpriteCursor> fallbackCursors;
+            SpriteBatch fallbackBatch;
+            std::size_t thread = omp_get_thread_num();
+            std::vector<SpriteCursor>& threadCursors = thread < cursors.size() ? cursors[thread] : (fallbackCursors = std::vector<SpriteCursor>(renderSprites.size()));
+            SpriteBatch& batch = thread < batches.size() ? batches[thread] : fallbackBatch;
+
+            EvaluateSprites(time, threadCursors, batch);
+            batch.ComputeQuads(frameScale, xOffset);
+            for (std::size_t i = 0; i < batch.Size(); i++)
             {
-                if (!(sprite->GetActiveTime().first <= time && sprite->GetActiveTime().second > time))
+                cv::Point2f quad[4];
+                std::copy(batch.quads.begin() + i * 4, batch.quads.begin() + i * 4 + 4, quad);
+                // sprites entirely outside the frame once zoomed draw nothing
+                float minX = std::min({ quad[0].x, quad[1].x, quad[2].x, quad[3].x });
+                float maxX = std::max({ quad[0].x, quad[1].x, quad[2].x, quad[3].x });
+                float minY = std::min({ quad[0].y, quad[1].y, quad[2].y, quad[3].y });
+                float maxY = std::max({ quad[0].y, quad[1].y, quad[2].y, quad[3].y });
+                auto zoomed = [&](float v, unsigned size) { return (v - size * 0.5f) * zoom + size * 0.5f; };
+                if (zoomed(maxX, resolution.first) < -1 || zoomed(minX, resolution.first) > resolution.first
+                    || zoomed(maxY, resolution.second) < -1 || zoomed(minY, resolution.second) > resolution.second)
                     continue;
-                if (sprite->GetLayer() == (showFailLayer ? Layer::Pass : Layer::Fail)) continue;
-                double alpha = sprite->OpacityAt(time);
-                if (alpha == 0) continue;
-                std::pair<double, double> scale = sprite->ScaleAt(time);
-                if (scale.first == 0 || scale.second == 0) continue;
-
-                std::unordered_map<std::string, cv::Mat>::const_iterator k = spriteImages.find(sprite->GetFilePath(time));
-                if (k == spriteImages.end()) continue;
-                const cv::Mat image = k->second;
-                const cv::MatConstIterator_<cv::Vec<float, 4>> imageStart = image.begin<cv::Vec<float, 4>>();
-
-                scale = std::pair<double, double>(scale.first * frameScale, scale.second * frameScale);
-                std::pair<double, double> newSize = std::pair<double, double>(image.cols * std::abs(scale.first), image.rows * std::abs(scale.second));
-
-                if (newSize.first < 1 || newSize.second < 1) continue;
-
-                // create frame-space quad
-                float width = newSize.first;
-                float height = newSize.second;
-                std::pair<double, double> position = sprite->PositionAt(time);
-                cv::Vec2f positionVec = { (float)position.first, (float)position.second };
-                cv::Vec2f origin = GetOriginVector(sprite->GetOrigin(), width, height);
-                cv::Vec2f centre = GetOriginVector(Origin::Centre, width, height);
-                float rotation = sprite->RotationAt(time);
-                if (rotation != 0)
-                {
-                    centre -= origin;
-                    centre =
-                    {
-                        centre[0] * std::cos(rotation) - centre[1] * std::sin(rotation),
-                        centre[1] * std::cos(rotation) + centre[0] * std::sin(rotation)
-                    };
-                    centre += origin;
-                }
-                cv::Vec2f frameQuadCentrePoint = positionVec * frameScale
-                    + centre - origin
-                    + cv::Vec2f(xOffset, 0);
-                cv::RotatedRect quadRect = cv::RotatedRect(frameQuadCentrePoint, cv::Size2f(width, height), rotation != 0 ? rotation * 180.0f / PI : 0);
-                cv::Point2f quad[4]; // bottomLeft, topLeft, topRight, bottomRight
-                quadRect.points(quad);
-
-                // flip quad if needed
-                // TODO: check if it's OR or XOR
-                bool flipH = sprite->EffectAt(time, ParameterType::FlipH) || scale.first < 0;
-                bool flipV = sprite->EffectAt(time, ParameterType::FlipV) || scale.second < 0;
-                if (flipH && flipV)
-                {
-                    std::swap(quad[0], quad[2]);
-                    std::swap(quad[1], quad[3]);
-                }
-                else if (flipH)
-                {
-                    std::swap(quad[0], quad[3]);
-                    std::swap(quad[1], quad[2]);
-                }
-                else if (flipV)
-                {
-                    std::swap(quad[0], quad[1]);
-                    std::swap(quad[2], quad[3]);
-                }
-
-                Colour colour = sprite->ColourAt(time);
-                bool additive = sprite->EffectAt(time, ParameterType::Additive);
-
-                RasteriseQuad(frameStart, imageStart, image.cols, image.rows, quad, colour, additive, alpha);
+                const cv::Mat& image = textures[batch.texture[i]];
+                RasteriseQuad(frameStart, image.begin<cv::Vec<float, 4>>(), image.cols, image.rows, quad,
+                    Colour(batch.r[i], batch.g[i], batch.b[i]), batch.flags[i] & SpriteBatch::Additive, batch.alpha[i]);
             }
             return frame;
         }
     private:
+        // fills the batch with the state of every sprite drawn at time, in drawing order, leaving out those that wouldn't show
+        void EvaluateSprites(double time, std::vector<SpriteCursor>& threadCursors, SpriteBatch& batch) const
+        {
+            batch.Clear();
+            std::pair<const std::uint32_t*, const std::uint32_t*> candidates = activeSprites.At(time);
+            for (const std::uint32_t* k = candidates.first; k != candidates.second; k++)
+            {
+                std::uint32_t i = *k;
+                const RenderSprite& sprite = renderSprites[i];
+                if (!(sprite.activetime.first <= time && sprite.activetime.second > time))
+                    continue;
+                SpriteState state = renderTracks.StateAt(sprite.keyframes, time, threadCursors[i], easingTables);
+                if (state.opacity == 0) continue;
+                if (state.scale.first == 0 || state.scale.second == 0) continue;
+                int animationFrame = sprite.FrameAt(time);
+                if (animationFrame < 0 || animationFrame >= sprite.frameCount) continue;
+                std::uint32_t texture = frames[sprite.firstFrame + animationFrame];
+                const cv::Mat& image = textures[texture];
+                double width = image.cols * std::abs(state.scale.first * frameScale);
+                double height = image.rows * std::abs(state.scale.second * frameScale);
+                if (width < 1 || height < 1) continue;
+
+                cv::Vec2f origin = GetOriginVector(sprite.origin, 2, 2);
+                batch.x.push_back(state.position.first);
+                batch.y.push_back(state.position.second);
+                batch.width.push_back(width);
+                batch.height.push_back(height);
+                batch.rotation.push_back(state.rotation);
+                batch.r.push_back(state.colour.R);
+                batch.g.push_back(state.colour.G);
+                batch.b.push_back(state.colour.B);
+                batch.alpha.push_back(state.opacity);
+                batch.originX.push_back(origin[0] * 0.5f);
+                batch.originY.push_back(origin[1] * 0.5f);
+                // TODO: check if it's OR or XOR
+                batch.flags.push_back((state.flipH || state.scale.first < 0 ? SpriteBatch::FlipH : 0)
+                    | (state.flipV || state.scale.second < 0 ? SpriteBatch::FlipV : 0)
+                    | (state.additive ? SpriteBatch::Additive : 0));
+                batch.texture.push_back(texture);
+            }
+        }
         cv::Mat GetVideoImage(double time)
         {
             int offset = 500;
@@ -513,13 +745,14 @@ namespace sb
             }
         }
     private:
-        std::filesystem::path directory;
+        const SongFolder& folder;
         std::string osb;
         std::string diff;
-        std::vector<std::unique_ptr<Sprite>> sprites;
+        std::vector<RenderSprite> renderSprites;
+        RenderTracks renderTracks;
+        ActiveSpriteIndex activeSprites;
         Background background;
         std::vector<Sample> samples;
-        std::vector<std::pair<double, HitSound>> hitSounds;
         std::unordered_map<std::string, std::string> info;
         std::pair<double, double> activetime;
         std::pair<unsigned, unsigned> resolution;
@@ -529,7 +762,11 @@ namespace sb
         bool showFailLayer;
         double audioDuration;
         double audioLeadIn;
-        std::unordered_map<std::string, cv::Mat> spriteImages;
+        std::unordered_map<std::string, double> sampleDurations;
+        std::vector<cv::Mat> textures;
+        std::vector<std::uint32_t> frames; // indices into textures of each render sprite's frames
+        std::vector<std::vector<SpriteCursor>> cursors; // per rendering thread, per render sprite
+        std::vector<SpriteBatch> batches; // per rendering thread
         cv::Mat blankImage;
         cv::Mat backgroundImage;
         Video video;
@@ -540,5 +777,7 @@ namespace sb
         double frameScale;
         double xOffset;
         float zoom;
+        // ease keyframes through the float EasingTables
+        bool easingTables;
     };
 }
@@ -1,7 +1,13 @@
 #pragma once
 
-#include <memory>
 #include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
 
 namespace sb
 {
@@ -37,103 +43,99 @@ namespace sb
         double B;
     };
 
-    class IEvent
+    // every command parsed from a file, stored column by column so a sprite refers to its commands by index range instead of owning one heap object each
+    // start and end values go to one column per value type, and the copies that loops and triggers expand a command into share its slot
+    class EventArena
     {
     public:
-        virtual std::unique_ptr<IEvent> copy() const = 0;
-        virtual EventType GetType() const = 0;
-        virtual Easing GetEasing() const = 0;
-        virtual double GetStartTime() const = 0;
-        virtual double GetEndTime() const = 0;
-        virtual void SetStartTime(double) = 0;
-        virtual void SetEndTime(double) = 0;
-        virtual int GetTriggerID() const = 0;
-        virtual double GetTriggerST() const = 0;
-        virtual int GetTriggerGP() const = 0;
-        virtual void SetTriggerID(int, double, int) = 0;
-        virtual ~IEvent() {}
-    };
-    template <typename T>
-    class Event : public IEvent
-    {
-    public:
-        Event() = default;
-        Event(EventType type, Easing easing, double starttime, double endtime, T startvalue, T endvalue, int triggerID = 0, double triggerST = 0, double triggerGP = 0)
-            :
-            type(type),
-            easing(easing),
-            starttime(starttime),
-            endtime(endtime),
-            startvalue(startvalue),
-            endvalue(endvalue),
-            triggerID(triggerID),
-            triggerST(triggerST),
-            triggerGP(triggerGP)
-        {}
-        std::unique_ptr<IEvent> copy() const
-        {
-            return std::make_unique<Event<T>>(type, easing, starttime, endtime, startvalue, endvalue, triggerID, triggerST, triggerGP);
-        }
-        EventType GetType() const
+        template <typename T>
+        void Add(EventType type, Easing easing, double starttime, double endtime, T startvalue, T endvalue, std::int32_t group)
         {
-            return type;
+            std::vector<T>& column = Values<T>();
+            types.push_back(type);
+            easings.push_back(easing);
+            starttimes.push_back(starttime);
+            endtimes.push_back(endtime);
+            groups.push_back(group);
+            values.push_back((std::uint32_t)column.size());
+            column.push_back(startvalue);
+            column.push_back(endvalue);
         }
-        Easing GetEasing() const
+        std::uint32_t Size() const
         {
-            return easing;
+            return (std::uint32_t)types.size();
         }
-        double GetStartTime() const
+        EventType GetType(std::uint32_t index) const
         {
-            return starttime;
+            return types[index];
         }
-        double GetEndTime() const
+        Easing GetEasing(std::uint32_t index) const
         {
-            return endtime;
+            return easings[index];
         }
-        void SetStartTime(double time)
+        double GetStartTime(std::uint32_t index) const
         {
-            starttime = time;
+            return starttimes[index];
         }
-        void SetEndTime(double time)
+        double GetEndTime(std::uint32_t index) const
         {
-            endtime = time;
+            return endtimes[index];
         }
-        T GetStartValue() const
+        // 0 for a command directly on its sprite, n + 1 for one in the sprite's nth loop, -(n + 1) for one in its nth trigger
+        std::int32_t GetGroup(std::uint32_t index) const
         {
-            return startvalue;
+            return groups[index];
         }
-        T GetEndValue() const
+        template <typename T>
+        const T& GetStartValue(std::uint32_t index) const
         {
-            return endvalue;
+            return Values<T>()[values[index]];
         }
-        int GetTriggerID() const
+        template <typename T>
+        const T& GetEndValue(std::uint32_t index) const
         {
-            return triggerID;
+            return Values<T>()[values[index] + 1];
         }
-        double GetTriggerST() const
-        {
-            return triggerST;
-        }
-        int GetTriggerGP() const
+    private:
+        template <typename T>
+        std::vector<T>& Values()
         {
-            return triggerGP;
+            return const_cast<std::vector<T>&>(static_cast<const EventArena*>(this)->Values<T>());
         }
-        void SetTriggerID(int id, double st, int gp)
+        template <typename T>
+        const std::vector<T>& Values() const
         {
-            triggerID = id;
-            triggerST = st;
-            triggerGP = gp;
+            if constexpr (std::is_same_v<T, double>) return doubles;
+            else if constexpr (std::is_same_v<T, std::pair<double, double>>) return pairs;
+            else if constexpr (std::is_same_v<T, Colour>) return colours;
+            else
+            {
+                static_assert(std::is_same_v<T, ParameterType>, "Unsupported event value type");
+                return parameters;
+            }
         }
-    private:
-        EventType type;
-        Easing easing;
+        std::vector<EventType> types;
+        std::vector<Easing> easings;
+        std::vector<double> starttimes;
+        std::vector<double> endtimes;
+        std::vector<std::int32_t> groups;
+        std::vector<std::uint32_t> values;
+        std::vector<double> doubles;
+        std::vector<std::pair<double, double>> pairs;
+        std::vector<Colour> colours;
+        std::vector<ParameterType> parameters;
+    };
+
+    // one occurrence of an arena command once loops and triggers have been expanded
+    struct EventInstance
+    {
+        std::uint32_t index;
         double starttime;
         double endtime;
-        T startvalue;
-        T endvalue;
-        int triggerID;
-        double triggerST;
-        int triggerGP;
+        int triggerID = 0; // 1-based index of the trigger activation it's a copy for, if any
+        int triggerGP = 0;
+        std::uint16_t repeat = 0; // 1-based index of the loop it's an iteration of, if that loop is evaluated symbolically
+        std::uint16_t iteration = 0;
     };
 
     // https://osu.ppy.sh/wiki/en/osu%21_File_Formats/Osu_%28file_format%29#hitsounds
@@ -185,6 +187,12 @@ namespace sb
         {
             return triggerType.find("HitSound") == 0;
         }
+        // identifies hitsounds that are exactly the same, unlike operator== which treats -1 in the right-hand side as a wildcard
+        std::uint32_t Key() const
+        {
+            return (std::uint32_t)(unsigned char)normalSet | (std::uint32_t)(unsigned char)additionSet << 8
+                | (std::uint32_t)(unsigned char)additionFlag << 16 | (std::uint32_t)(unsigned char)index << 24;
+        }
 
     private:
         char normalSet = 0; // 0 - no sample set, 1 - normal, 2 - soft, 3 - drum
@@ -192,4 +200,57 @@ namespace sb
         char additionFlag = 0; // bitflag: 0 - normal, 1 - whistle, 2 - finish, 3 - clap
         char index = 0;
     };
+
+    // a map's hitsounds sorted by time and grouped by the exact hitsound, so that a trigger only has to be matched against the few distinct
+    // hitsounds in a map and then binary search the groups it matches for its time window
+    class HitSoundIndex
+    {
+    public:
+        HitSoundIndex() = default;
+        HitSoundIndex(const std::vector<std::pair<double, HitSound>>& hitSounds)
+        {
+            // hitsounds at the same time keep the order they were parsed in
+            std::vector<std::uint32_t> order(hitSounds.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+                return hitSounds[a].first < hitSounds[b].first;
+                });
+            times.reserve(hitSounds.size());
+            std::unordered_map<std::uint32_t, std::size_t> groupIndex;
+            for (std::uint32_t i : order)
+            {
+                const HitSound& hitSound = hitSounds[i].second;
+                auto k = groupIndex.emplace(hitSound.Key(), groups.size()).first;
+                if (k->second == groups.size()) groups.push_back({ hitSound, {} });
+                groups[k->second].second.push_back((std::uint32_t)times.size());
+                times.push_back(hitSounds[i].first);
+            }
+        }
+        // times in [starttime, endtime) of the hitsounds that match a trigger's, in order
+        std::vector<double> Find(const HitSound& trigger, double starttime, double endtime) const
+        {
+            std::vector<std::uint32_t> found;
+            for (const std::pair<HitSound, std::vector<std::uint32_t>>& group : groups)
+            {
+                if (!(group.first == trigger)) continue;
+                const std::vector<std::uint32_t>& positions = group.second;
+                auto begin = std::lower_bound(positions.begin(), positions.end(), starttime, [&](std::uint32_t position, double time) { return times[position] < time; });
+                auto end = std::lower_bound(begin, positions.end(), endtime, [&](std::uint32_t position, double time) { return times[position] < time; });
+                std::size_t middle = found.size();
+                found.insert(found.end(), begin, end);
+                std::inplace_merge(found.begin(), found.begin() + middle, found.end());
+            }
+            std::vector<double> result;
+            result.reserve(found.size());
+            for (std::uint32_t position : found) result.push_back(times[position]);
+            return result;
+        }
+        std::size_t Size() const
+        {
+            return times.size();
+        }
+    private:
+        std::vector<double> times;
+        std::vector<std::pair<HitSound, std::vector<std::uint32_t>>> groups;
+    };
 }
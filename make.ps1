@@ -67,3 +67,23 @@ ForEach ($file in $main_files) {
     }
     $index++;
 }
+
+# TESTS
+
+$test_files = ls tests/*.cpp;
+mkdir obj/tests -erroraction ignore >$null 2>&1;
+mkdir bin/tests -erroraction ignore >$null 2>&1;
+ForEach ($file in $test_files) {
+    $base = $file.BaseName;
+    $name = $file.Name;
+    $compiled = 0;
+    if (-not (Test-Path -Path obj/tests/$base.o)) {
+        echo "Compiling $name...";
+        clang $file -std=c++17 -I lib -I dep/gifdec/lib -I $OPENCV_INCLUDE -O3 -fopenmp -c -o "obj/tests/$base.o" -Wno-unsequenced;
+        if ($LASTEXITCODE -eq 0) { $compiled = 1; }
+    }
+    if ((-not (Test-Path -Path "bin/tests/$base.exe")) -or $should_link -or $compiled) {
+        echo "Linking tests/$base.exe...";
+        clang obj/dep/gifdec/*.o obj/lib/*.o obj/tests/$base.o -L $OPENCV_LINK -l $OPENCV_LIB -o "bin/tests/$base.exe" -fopenmp;
+    }
+}
@@ -1,7 +1,9 @@
 #include <progressbar.hpp>
 #include <Storyboard.hpp>
+#include <EasingTables.hpp>
 
 #include <opencv2/opencv.hpp>
+#include <omp.h>
 #include <iostream>
 #include <string>
 #include <memory>
@@ -9,12 +11,13 @@
 #include <string>
 #include <functional>
 #include <optional>
+#include <algorithm>
 
 void printUsageAndExit(std::vector<std::tuple<bool, std::string, std::string, std::function<void(std::string&)>, std::string, std::string>> options, std::string filename)
 {
     constexpr unsigned wrapLimit = 80;
     constexpr unsigned tabLimit = 20;
-    std::cerr << "\nUsage: " << std::filesystem::path(filename).filename().string() << " song_folder [options]\n\noptions:\n";
+    std::cerr << "\nUsage: " << std::filesystem::path(filename).filename().string() << " song_folder_or_osz [options]\n\noptions:\n";
     for (auto& o : options)
     {
         std::string optionsString = " " + std::get<1>(o) + ", " + std::get<2>(o) + " ";
@@ -36,6 +39,18 @@ void printUsageAndExit(std::vector<std::tuple<bool, std::string, std::string, st
     exit(1);
 }
 
+// video.mp4 and "Artist - Title (Mapper) [Hard].osu" -> "video [Hard].mp4"
+std::string difficultyOutputFile(const std::string& outputFile, const std::string& diff)
+{
+    std::string name = std::filesystem::path(diff).stem().string();
+    std::size_t open = name.rfind('[');
+    std::size_t close = name.rfind(']');
+    if (open != std::string::npos && close != std::string::npos && close > open)
+        name = name.substr(open + 1, close - open - 1);
+    std::filesystem::path path(outputFile);
+    return (path.parent_path() / (path.stem().string() + " [" + name + "]" + path.extension().string())).string();
+}
+
 int main(int argc, char* argv[]) {
     std::string filename = argv[0];
     std::string directory;
@@ -55,6 +70,15 @@ int main(int argc, char* argv[]) {
     std::string outputFile = "video.mp4";
     bool keepTemporaryFiles = false;
     float zoom = 1;
+    bool legacyParser = false;
+    int threads = 0;
+    bool benchmarkParser = false;
+    bool benchmarkEasing = false;
+    bool noCache = false;
+    bool allDifficulties = false;
+    double linearisationError = 0;
+    bool compactKeyframes = false;
+    bool easingTables = false;
 
     std::vector<std::string> arguments;
     for (int i = 0; i < argc; i++)
@@ -86,7 +110,16 @@ int main(int argc, char* argv[]) {
         opt(false, "-ar", "--respect-aspect-ratio", useStoryboardAspectRatio, true, "change to 4:3 aspect ratio if WidescreenStoryboard is disabled in the difficulty file", ""),
         opt(false, "-fail", "--show-fail-layer", showFailLayer, true, "show the fail layer instead of the pass layer", ""),
         opt(false, "-keep", "--keep-temp-files", keepTemporaryFiles, true, "don't delete temporary files (temp.mp3 & temp.avi)", ""),
-        opt(true, "-z", "--zoom", zoom, std::stof(arg), "zoom factor to use when rendering, useful for checking out-of-bounds sprites (default: 1)", "factor")
+        opt(true, "-z", "--zoom", zoom, std::stof(arg), "zoom factor to use when rendering, useful for checking out-of-bounds sprites (default: 1)", "factor"),
+        opt(true, "-j", "--threads", threads, std::stoi(arg), "number of worker threads for parsing, initialisation and rendering (default: all cores)", "count"),
+        opt(false, "-lp", "--legacy-parser", legacyParser, true, "parse with the line-by-line stream parser instead of the memory-mapped one", ""),
+        opt(false, "-bp", "--benchmark-parser", benchmarkParser, true, "time both parsers on the storyboard, print lines/sec and exit", ""),
+        opt(false, "-be", "--benchmark-easing", benchmarkEasing, true, "time the easing functions against their float lookup tables, print ns/eval and the largest error, and exit", ""),
+        opt(false, "-nc", "--no-cache", noCache, true, "don't read or write the parsed storyboard cache (<difficulty>.osbc)", ""),
+        opt(true, "-lin", "--linearise", linearisationError, std::stod(arg), "replace eased commands with linear segments drawn at most this many pixels (or 255ths of opacity/colour) off, for faster rendering (default: off)", "pixels"),
+        opt(false, "-ck", "--compact-keyframes", compactKeyframes, true, "store keyframes with float times and values, which takes about a third of the memory", ""),
+        opt(false, "-et", "--easing-tables", easingTables, true, "ease keyframes through float lookup tables when rendering, which is faster and within about 1e-6 of the exact easings (see -be)", ""),
+        opt(false, "-all", "--all-difficulties", allDifficulties, true, "render every difficulty in the folder, parsing the .osb and loading its images only once; each video is named after its difficulty, e.g. video [Hard].mp4", "")
 #undef opt
     };
 
@@ -122,19 +155,23 @@ int main(int argc, char* argv[]) {
         }
         if (!optionFound && directory.empty()) directory = *arg;
     }
+    if (benchmarkEasing)
+    {
+        sb::BenchmarkEasing();
+        return 0;
+    }
     if (directory.empty())
     {
         std::cerr << "No song folder specified!\n";
         printUsageAndExit(options, filename);
     }
 
-    std::unique_ptr<sb::Storyboard> sb;
+    if (threads > 0) omp_set_num_threads(threads);
 
+    std::unique_ptr<sb::SongFolder> folder;
     try
     {
-        sb = std::make_unique<sb::Storyboard>(
-            directory, diff, std::pair<unsigned, unsigned>(frameWidth, frameHeight),
-            musicVolume * volume, effectVolume * volume, dim, useStoryboardAspectRatio, showFailLayer, zoom);
+        folder = std::make_unique<sb::SongFolder>(directory);
     }
     catch (std::exception e)
     {
@@ -142,52 +179,105 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
 
-    std::pair<double, double> activetime = sb->GetActiveTime();
-    std::pair<unsigned, unsigned> resolution = sb->GetResolution();
-    double audioLeadIn = sb->GetAudioLeadIn();
-    double audioDuration = sb->GetAudioDuration();
-    double starttime = _starttime.value_or(std::min(activetime.first, audioLeadIn));
-    double duration = _duration.has_value() ?
-        _duration.value()
-        : (_endtime.has_value() ?
-            _endtime.value() - starttime
-            : std::max(activetime.second, audioDuration) - starttime);
-    
-    std::cout << "Generating audio...";
-    sb->generateAudio("temp.mp3");
-
-    int frameCount = (int)std::ceil(fps * duration / 1000.0);
-    cv::VideoWriter writer = cv::VideoWriter(
-        "temp.avi",
-        cv::VideoWriter::fourcc('m', 'p', '4', 'v'),
-        fps,
-        cv::Size(resolution.first, resolution.second)
-    );
-
-    ProgressBar progress("Rendering video: ", frameCount, 0, 0.5f);
-#pragma omp parallel for ordered schedule(dynamic)
-    for (int i = 0; i < frameCount; i++)
+    if (benchmarkParser)
     {
-        cv::Mat frame = sb->DrawFrame(starttime + i * 1000.0 / fps);
-#pragma omp ordered
+        try
+        {
+            std::string osb;
+            sb::FindStoryboardFiles(*folder, osb, diff);
+            sb::BenchmarkParser(*folder, osb, diff);
+        }
+        catch (std::exception e)
         {
-            writer.write(frame);
-            progress.update();
+            std::cerr << e.what() << std::endl;
+            exit(1);
         }
+        return 0;
     }
-    writer.release();
-    progress.finish();
-
-    std::cout << "Merging audio and video...\n";
-    std::stringstream command;
-    command << std::fixed << "ffmpeg -y -v error -stats -i temp.avi -ss " << starttime + sb->GetAudioLeadIn() << "ms -to "
-        << starttime + duration + sb->GetAudioLeadIn() << "ms -accurate_seek -i temp.mp3 -c:v copy " << outputFile;
-    system(command.str().c_str());
-    if (!keepTemporaryFiles)
+
+    std::vector<std::string> difficulties = { diff };
+    std::unique_ptr<sb::SharedStoryboard> shared;
+    if (allDifficulties)
     {
-        std::cout << "Deleting temporary files...\n";
-        sb::removeFile("temp.mp3");
-        sb::removeFile("temp.avi");
+        difficulties = folder->GetFileNames(".osu");
+        std::sort(difficulties.begin(), difficulties.end());
+        try
+        {
+            shared = std::make_unique<sb::SharedStoryboard>(*folder);
+        }
+        catch (std::exception e)
+        {
+            std::cerr << e.what() << std::endl;
+            exit(1);
+        }
+    }
+
+    for (const std::string& difficulty : difficulties)
+    {
+        std::string output = allDifficulties ? difficultyOutputFile(outputFile, difficulty) : outputFile;
+        if (allDifficulties) std::cout << "Rendering " << difficulty << " to " << output << "\n";
+
+        std::unique_ptr<sb::Storyboard> sb;
+
+        try
+        {
+            sb = std::make_unique<sb::Storyboard>(
+                *folder, difficulty, std::pair<unsigned, unsigned>(frameWidth, frameHeight),
+                musicVolume * volume, effectVolume * volume, dim, useStoryboardAspectRatio, showFailLayer, zoom, legacyParser, !noCache, shared.get(), linearisationError, compactKeyframes, easingTables);
+        }
+        catch (std::exception e)
+        {
+            std::cerr << e.what() << std::endl;
+            exit(1);
+        }
+
+        std::pair<double, double> activetime = sb->GetActiveTime();
+        std::pair<unsigned, unsigned> resolution = sb->GetResolution();
+        double audioLeadIn = sb->GetAudioLeadIn();
+        double audioDuration = sb->GetAudioDuration();
+        double starttime = _starttime.value_or(std::min(activetime.first, audioLeadIn));
+        double duration = _duration.has_value() ?
+            _duration.value()
+            : (_endtime.has_value() ?
+                _endtime.value() - starttime
+                : std::max(activetime.second, audioDuration) - starttime);
+    
+        std::cout << "Generating audio...";
+        sb->generateAudio("temp.mp3");
+
+        int frameCount = (int)std::ceil(fps * duration / 1000.0);
+        cv::VideoWriter writer = cv::VideoWriter(
+            "temp.avi",
+            cv::VideoWriter::fourcc('m', 'p', '4', 'v'),
+            fps,
+            cv::Size(resolution.first, resolution.second)
+        );
+
+        ProgressBar progress("Rendering video: ", frameCount, 0, 0.5f);
+#pragma omp parallel for ordered schedule(dynamic)
+        for (int i = 0; i < frameCount; i++)
+        {
+            cv::Mat frame = sb->DrawFrame(starttime + i * 1000.0 / fps);
+#pragma omp ordered
+            {
+                writer.write(frame);
+                progress.update();
+            }
+        }
+        writer.release();
+        progress.finish();
+
+        std::cout << "Merging audio and video...\n";
+        std::stringstream command;
+        command << std::fixed << "ffmpeg -y -v error -stats -i temp.avi -ss " << starttime + sb->GetAudioLeadIn() << "ms -to "
+            << starttime + duration + sb->GetAudioLeadIn() << "ms -accurate_seek -i temp.mp3 -c:v copy \"" << output << "\"";
+        system(command.str().c_str());
+        if (!keepTemporaryFiles)
+        {
+            std::cout << "Deleting temporary files...\n";
+            sb::removeFile("temp.mp3");
+            sb::removeFile("temp.avi");
+        }
     }
 
     std::cout << "Done\n";
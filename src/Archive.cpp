@@ -0,0 +1,321 @@
+#include <Archive.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace sb
+{
+    namespace
+    {
+        // lsb-first bit reader over the deflate stream
+        struct BitReader
+        {
+            const unsigned char* data;
+            std::size_t size;
+            std::size_t pos = 0;
+            std::uint32_t buffer = 0;
+            int count = 0;
+            bool Bits(int need, int& value)
+            {
+                while (count < need)
+                {
+                    if (pos >= size) return false;
+                    buffer |= (std::uint32_t)data[pos++] << count;
+                    count += 8;
+                }
+                value = (int)(buffer & ((1u << need) - 1));
+                buffer >>= need;
+                count -= need;
+                return true;
+            }
+        };
+
+        // canonical huffman code stored as the number of codes per length plus the symbols in code order (as in zlib's puff)
+        struct Huffman
+        {
+            short count[16];
+            short symbol[288];
+        };
+
+        bool buildHuffman(Huffman& huffman, const short* lengths, int n)
+        {
+            std::memset(huffman.count, 0, sizeof huffman.count);
+            for (int i = 0; i < n; i++) huffman.count[lengths[i]]++;
+            if (huffman.count[0] == n) return true;
+            int left = 1;
+            for (int length = 1; length < 16; length++)
+            {
+                left <<= 1;
+                left -= huffman.count[length];
+                if (left < 0) return false; // oversubscribed
+            }
+            short offsets[16];
+            offsets[1] = 0;
+            for (int length = 1; length < 15; length++) offsets[length + 1] = offsets[length] + huffman.count[length];
+            for (int i = 0; i < n; i++)
+                if (lengths[i] != 0) huffman.symbol[offsets[lengths[i]]++] = (short)i;
+            return true;
+        }
+
+        int decodeSymbol(BitReader& in, const Huffman& huffman)
+        {
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (int length = 1; length < 16; length++)
+            {
+                int bit;
+                if (!in.Bits(1, bit)) return -1;
+                code |= bit;
+                int count = huffman.count[length];
+                if (code - count < first) return huffman.symbol[index + (code - first)];
+                index += count;
+                first += count;
+                first <<= 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+
+        const short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        const short lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        const short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        const short distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        bool inflateBlock(BitReader& in, const Huffman& lengthCodes, const Huffman& distanceCodes, char* out, std::size_t outSize, std::size_t& outPos)
+        {
+            while (true)
+            {
+                int symbol = decodeSymbol(in, lengthCodes);
+                if (symbol < 0) return false;
+                if (symbol < 256)
+                {
+                    if (outPos >= outSize) return false;
+                    out[outPos++] = (char)symbol;
+                    continue;
+                }
+                if (symbol == 256) return true;
+                symbol -= 257;
+                if (symbol >= 29) return false;
+                int extra;
+                if (!in.Bits(lengthExtra[symbol], extra)) return false;
+                std::size_t length = lengthBase[symbol] + extra;
+                symbol = decodeSymbol(in, distanceCodes);
+                if (symbol < 0 || symbol >= 30) return false;
+                if (!in.Bits(distanceExtra[symbol], extra)) return false;
+                std::size_t distance = distanceBase[symbol] + extra;
+                if (distance > outPos || length > outSize - outPos) return false;
+                // byte by byte, as the source may overlap what's being written
+                for (; length > 0; length--, outPos++) out[outPos] = out[outPos - distance];
+            }
+        }
+
+        bool readDynamicCodes(BitReader& in, Huffman& lengthCodes, Huffman& distanceCodes)
+        {
+            static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            int literalCount, distanceCount, codeCount;
+            if (!in.Bits(5, literalCount) || !in.Bits(5, distanceCount) || !in.Bits(4, codeCount)) return false;
+            literalCount += 257;
+            distanceCount += 1;
+            codeCount += 4;
+            if (literalCount > 286 || distanceCount > 30) return false;
+
+            short lengths[320] = {};
+            for (int i = 0; i < codeCount; i++)
+            {
+                int length;
+                if (!in.Bits(3, length)) return false;
+                lengths[order[i]] = (short)length;
+            }
+            Huffman codeLengthCodes;
+            if (!buildHuffman(codeLengthCodes, lengths, 19)) return false;
+
+            int index = 0;
+            while (index < literalCount + distanceCount)
+            {
+                int symbol = decodeSymbol(in, codeLengthCodes);
+                if (symbol < 0) return false;
+                if (symbol < 16)
+                {
+                    lengths[index++] = (short)symbol;
+                    continue;
+                }
+                short length = 0;
+                int repeat;
+                if (symbol == 16)
+                {
+                    if (index == 0) return false;
+                    length = lengths[index - 1];
+                    if (!in.Bits(2, repeat)) return false;
+                    repeat += 3;
+                }
+                else if (symbol == 17)
+                {
+                    if (!in.Bits(3, repeat)) return false;
+                    repeat += 3;
+                }
+                else
+                {
+                    if (!in.Bits(7, repeat)) return false;
+                    repeat += 11;
+                }
+                if (index + repeat > literalCount + distanceCount) return false;
+                while (repeat--) lengths[index++] = length;
+            }
+            if (lengths[256] == 0) return false;
+            return buildHuffman(lengthCodes, lengths, literalCount) && buildHuffman(distanceCodes, lengths + literalCount, distanceCount);
+        }
+
+        std::uint16_t read16(const char* p)
+        {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            return (std::uint16_t)(u[0] | u[1] << 8);
+        }
+
+        std::uint32_t read32(const char* p)
+        {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            return (std::uint32_t)u[0] | (std::uint32_t)u[1] << 8 | (std::uint32_t)u[2] << 16 | (std::uint32_t)u[3] << 24;
+        }
+    }
+
+    bool inflate(std::string_view in, char* out, std::size_t outSize)
+    {
+        BitReader reader = { reinterpret_cast<const unsigned char*>(in.data()), in.size() };
+        std::size_t outPos = 0;
+        int last;
+        do
+        {
+            int type;
+            if (!reader.Bits(1, last) || !reader.Bits(2, type)) return false;
+            if (type == 0)
+            {
+                // stored block, starts at the next byte boundary
+                reader.buffer = 0;
+                reader.count = 0;
+                if (reader.size - reader.pos < 4) return false;
+                std::size_t length = read16(in.data() + reader.pos);
+                if ((std::uint16_t)~length != read16(in.data() + reader.pos + 2)) return false;
+                reader.pos += 4;
+                if (length > reader.size - reader.pos || length > outSize - outPos) return false;
+                std::memcpy(out + outPos, in.data() + reader.pos, length);
+                reader.pos += length;
+                outPos += length;
+            }
+            else if (type == 1)
+            {
+                static Huffman fixedLengthCodes;
+                static Huffman fixedDistanceCodes;
+                static const bool built = []()
+                {
+                    short lengths[288];
+                    for (int i = 0; i < 288; i++) lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+                    buildHuffman(fixedLengthCodes, lengths, 288);
+                    for (int i = 0; i < 30; i++) lengths[i] = 5;
+                    buildHuffman(fixedDistanceCodes, lengths, 30);
+                    return true;
+                }();
+                (void)built;
+                if (!inflateBlock(reader, fixedLengthCodes, fixedDistanceCodes, out, outSize, outPos)) return false;
+            }
+            else if (type == 2)
+            {
+                Huffman lengthCodes;
+                Huffman distanceCodes;
+                if (!readDynamicCodes(reader, lengthCodes, distanceCodes)) return false;
+                if (!inflateBlock(reader, lengthCodes, distanceCodes, out, outSize, outPos)) return false;
+            }
+            else return false;
+        } while (!last);
+        return outPos == outSize;
+    }
+
+    Archive::Archive(const std::filesystem::path& filepath)
+        :
+        file(filepath)
+    {
+        if (!file.IsOpen()) return;
+        std::string_view data = file.GetView();
+
+        // the end of central directory record sits at the very end, possibly followed by a comment of up to 64k
+        constexpr std::size_t endRecordSize = 22;
+        if (data.size() < endRecordSize) return;
+        std::size_t end = data.size() - endRecordSize;
+        std::size_t limit = end > 0xFFFF ? end - 0xFFFF : 0;
+        while (read32(data.data() + end) != 0x06054b50)
+        {
+            if (end == limit) return;
+            end--;
+        }
+        std::size_t entryCount = read16(data.data() + end + 10);
+        std::size_t directorySize = read32(data.data() + end + 12);
+        std::size_t directoryOffset = read32(data.data() + end + 16);
+        if (directoryOffset > data.size() || directorySize > data.size() - directoryOffset) return; // zip64 isn't supported
+
+        std::size_t pos = directoryOffset;
+        entries.reserve(entryCount);
+        for (std::size_t i = 0; i < entryCount; i++)
+        {
+            constexpr std::size_t headerSize = 46;
+            if (data.size() - pos < headerSize || read32(data.data() + pos) != 0x02014b50) return;
+            const char* header = data.data() + pos;
+            std::uint16_t flags = read16(header + 8);
+            Entry entry;
+            entry.method = read16(header + 10);
+            entry.compressedSize = read32(header + 20);
+            entry.size = read32(header + 24);
+            std::size_t nameLength = read16(header + 28);
+            std::size_t extraLength = read16(header + 30);
+            std::size_t commentLength = read16(header + 32);
+            entry.localHeader = read32(header + 42);
+            if (data.size() - pos - headerSize < nameLength) return;
+            std::string name(header + headerSize, nameLength);
+            pos += headerSize + nameLength + extraLength + commentLength;
+            if (name.empty() || name.back() == '/' || name.back() == '\\') continue; // directory
+            if (flags & 1) continue; // encrypted
+            if (entries.emplace(NormaliseName(name), entry).second) names.push_back(name);
+        }
+        open = true;
+    }
+
+    std::string Archive::NormaliseName(std::string_view name)
+    {
+        std::string normalised;
+        normalised.reserve(name.size());
+        for (char c : name) normalised.push_back(c == '\\' ? '/' : (char)std::tolower(static_cast<unsigned char>(c)));
+        while (normalised.rfind("./", 0) == 0) normalised.erase(0, 2);
+        return normalised;
+    }
+
+    bool Archive::Contains(const std::string& name) const
+    {
+        return entries.find(NormaliseName(name)) != entries.end();
+    }
+
+    bool Archive::Read(const std::string& name, std::string& buffer, std::string_view& contents) const
+    {
+        auto k = entries.find(NormaliseName(name));
+        if (k == entries.end()) return false;
+        const Entry& entry = k->second;
+        std::string_view data = file.GetView();
+        constexpr std::size_t localHeaderSize = 30;
+        if (entry.localHeader > data.size() || data.size() - entry.localHeader < localHeaderSize) return false;
+        const char* header = data.data() + entry.localHeader;
+        if (read32(header) != 0x04034b50) return false;
+        std::size_t start = entry.localHeader + localHeaderSize + read16(header + 26) + read16(header + 28);
+        if (start > data.size() || entry.compressedSize > data.size() - start) return false;
+        std::string_view compressed = data.substr(start, entry.compressedSize);
+        if (entry.method == 0)
+        {
+            if (entry.compressedSize != entry.size) return false;
+            contents = compressed;
+            return true;
+        }
+        if (entry.method != 8) return false;
+        buffer.resize(entry.size);
+        if (!inflate(compressed, buffer.data(), buffer.size())) return false;
+        contents = buffer;
+        return true;
+    }
+}
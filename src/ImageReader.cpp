@@ -8,21 +8,12 @@
 
 namespace sb
 {
-    cv::Mat readImage(const std::string& filepath)
+    namespace
     {
-        cv::Mat fallback = cv::Mat::zeros(1, 1, CV_8UC4);
-        if (!std::filesystem::exists(filepath))
-            return fallback;
-
-        // try opencv
-        cv::Mat image = cv::imread(filepath, cv::IMREAD_UNCHANGED);
-        if (!image.empty()) return image;
-
-        // try gifdec
-        gd_GIF* gif = gd_open_gif(filepath.c_str());
-        if (gif)
+        // renders the first frame, transparent where the background colour is
+        cv::Mat readGif(gd_GIF* gif, const cv::Mat& fallback)
         {
-            image = cv::Mat(gif->height, gif->width, CV_8UC4);
+            cv::Mat image = cv::Mat(gif->height, gif->width, CV_8UC4);
             int ret = gd_get_frame(gif);
             if (ret == 0) return fallback;
             cv::MatIterator_<cv::Vec<uint8_t, 4>> imageStart = image.begin<cv::Vec<uint8_t, 4>>();
@@ -54,9 +45,53 @@ namespace sb
             }
             return image;
         }
+    }
+
+    cv::Mat readImage(const std::string& filepath)
+    {
+        cv::Mat fallback = cv::Mat::zeros(1, 1, CV_8UC4);
+        if (!std::filesystem::exists(filepath))
+            return fallback;
+
+        // try opencv
+        cv::Mat image = cv::imread(filepath, cv::IMREAD_UNCHANGED);
+        if (!image.empty()) return image;
+
+        // try gifdec
+        gd_GIF* gif = gd_open_gif(filepath.c_str());
+        if (gif)
+        {
+            image = readGif(gif, fallback);
+            gd_close_gif(gif);
+            return image;
+        }
 
         std::cout << "Image " + std::filesystem::path(filepath).filename().string()
             + " either is invalid or otherwise could not be read.";
         return fallback;
     }
-}
\ No newline at end of file
+
+    cv::Mat readImage(std::string_view data, const std::string& name)
+    {
+        cv::Mat fallback = cv::Mat::zeros(1, 1, CV_8UC4);
+        if (data.empty())
+            return fallback;
+
+        // try opencv, which only reads the buffer through the header
+        cv::Mat image = cv::imdecode(cv::Mat(1, (int)data.size(), CV_8U, const_cast<char*>(data.data())), cv::IMREAD_UNCHANGED);
+        if (!image.empty()) return image;
+
+        // try gifdec
+        gd_GIF* gif = gd_open_gif_memory(data.data(), data.size());
+        if (gif)
+        {
+            image = readGif(gif, fallback);
+            gd_close_gif(gif);
+            return image;
+        }
+
+        std::cout << "Image " + std::filesystem::path(name).filename().string()
+            + " either is invalid or otherwise could not be read.";
+        return fallback;
+    }
+}
@@ -0,0 +1,108 @@
+#include <MappedFile.hpp>
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sb
+{
+    MappedFile::MappedFile(const std::filesystem::path& filepath)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return;
+        }
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+        if (size == 0)
+        {
+            // empty files can't be mapped, but they're still valid input
+            CloseHandle(file);
+            open = true;
+            return;
+        }
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) return;
+        // the view keeps the mapping alive, so the handles can be closed straight away
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping);
+        open = data != nullptr;
+#else
+        int fd = ::open(filepath.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return;
+        }
+        size = static_cast<std::size_t>(st.st_size);
+        if (size == 0)
+        {
+            ::close(fd);
+            open = true;
+            return;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return;
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+        open = true;
+#endif
+        if (!open) size = 0;
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+        :
+        data(std::exchange(other.data, nullptr)),
+        size(std::exchange(other.size, 0)),
+        open(std::exchange(other.open, false))
+    {}
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+            open = std::exchange(other.open, false);
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    void MappedFile::Close()
+    {
+        if (data != nullptr)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(data);
+#else
+            munmap(const_cast<char*>(data), size);
+#endif
+        }
+        data = nullptr;
+        size = 0;
+        open = false;
+    }
+}
@@ -0,0 +1,159 @@
+#include <Components.hpp>
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cmath>
+#include <limits>
+
+// Track::Simplify has to leave every track evaluating the same as before: builds random sprites with loops, triggers, zero-length
+// events, runs of steps and runs of linear commands that are mostly collinear, simplifies their keyframes and compares both versions of every track
+// at dense samples, exactly at each keyframe time and just before it. only merged linear segments may differ, and only by rounding
+
+using namespace sb;
+
+std::size_t failures = 0;
+std::size_t samples = 0;
+
+template <typename T>
+void compareTracks(const std::string& name, int sprite, const Track<T>& before, const Track<T>& after)
+{
+    std::vector<double> times;
+    for (std::size_t i = 0; i < before.Size(); i++)
+    {
+        double time = before.At(i).time + before.GetTimeOffset();
+        if (!std::isfinite(time)) continue;
+        times.push_back(time);
+        times.push_back(std::nextafter(time, -std::numeric_limits<double>::infinity()));
+    }
+    for (double time = -1000; time < 40000; time += 2.5)
+        times.push_back(time);
+    for (double time : times)
+    {
+        samples++;
+        T expected = before.ValueAt(time);
+        T actual = after.ValueAt(time);
+        bool same;
+        if constexpr (std::is_same_v<T, bool>) same = expected == actual;
+        else same = keyframeValuesClose(expected, actual);
+        if (!same && failures++ < 20)
+            std::cerr << "sprite " << sprite << " " << name << " differs at " << time << ": " << keyframeValueDistance(expected, actual) << "\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned seed = argc > 1 ? std::stoul(argv[1]) : 1;
+    std::mt19937 random(seed);
+    auto between = [&](int low, int high) { return std::uniform_int_distribution<int>(low, high)(random); };
+    auto easing = [&]() { return between(0, 2) ? Easing::None : (Easing)between(0, (int)Easing::Step); };
+    std::size_t keyframesBefore = 0;
+    std::size_t keyframesAfter = 0;
+    for (int s = 0; s < 500; s++)
+    {
+        std::shared_ptr<EventArena> arena = std::make_shared<EventArena>();
+        Sprite sprite(Layer::Background, Origin::Centre, "sprite.png", { 320, 240 }, arena);
+        int time = between(-500, 2000);
+        for (int i = between(1, 8); i > 0; i--)
+        {
+            int duration = between(0, 3) ? between(1, 1500) : 0;
+            switch (between(0, 6))
+            {
+            case 0:
+                sprite.AddEvent(EventType::F, easing(), time, time + duration, between(0, 4) / 4.0, between(0, 4) / 4.0);
+                break;
+            case 1:
+                sprite.AddEvent(EventType::M, easing(), time, time + duration,
+                    std::pair<double, double>(between(0, 640), between(0, 480)), std::pair<double, double>(between(0, 640), between(0, 480)));
+                break;
+            case 2:
+                sprite.AddEvent(EventType::V, easing(), time, time + duration,
+                    std::pair<double, double>(between(0, 4) / 2.0, 1), std::pair<double, double>(1, between(0, 4) / 2.0));
+                break;
+            case 3:
+                sprite.AddEvent(EventType::C, easing(), time, time + duration,
+                    Colour(between(0, 9) / 9.0, 1, 0), Colour(0, between(0, 9) / 9.0, 1));
+                break;
+            case 4:
+                sprite.AddEvent(EventType::P, Easing::None, time, time + duration, (ParameterType)between(0, 2), (ParameterType)between(0, 2));
+                break;
+            case 5:
+            {
+                // zero-length commands holding the same value, which compile to runs of steps
+                double value = between(0, 2) / 2.0;
+                for (int j = between(2, 6); j > 0; j--, time += between(0, 200))
+                    sprite.AddEvent(EventType::S, Easing::None, time, time, value, between(0, 3) ? value : between(0, 2) / 2.0);
+                break;
+            }
+            case 6:
+            {
+                // linear commands continuing each other's line, now and then bending off it
+                double slope = between(-10, 10) / 20.0;
+                double value = between(0, 640);
+                for (int j = between(2, 6); j > 0; j--)
+                {
+                    if (between(0, 4) == 0) slope = between(-10, 10) / 20.0;
+                    int length = between(1, 800);
+                    int gap = between(0, 3) ? 0 : between(1, 100);
+                    sprite.AddEvent(EventType::MX, Easing::None, time, time + length, value, value + slope * length);
+                    value += slope * (length + gap);
+                    time += length + gap;
+                }
+                break;
+            }
+            }
+            time += between(-300, 1500);
+        }
+        if (between(0, 1))
+        {
+            sprite.AddLoop(Loop(between(0, 8000), between(1, 12)));
+            for (int i = between(1, 3); i > 0; i--)
+            {
+                int start = between(0, 400);
+                int duration = between(0, 2) ? between(1, 300) : 0;
+                if (between(0, 1)) sprite.AddEventInLoop(EventType::F, easing(), start, start + duration, between(0, 2) / 2.0, between(0, 2) / 2.0);
+                else sprite.AddEventInLoop(EventType::MX, Easing::None, start, start + duration, 100.0, 100.0 + duration);
+            }
+        }
+        if (between(0, 1))
+        {
+            static const char* triggers[] = { "HitSound", "HitSoundClap", "HitSoundSoft", "HitSoundNormalWhistle", "HitSoundDrum0" };
+            sprite.AddTrigger(Trigger(triggers[between(0, 4)], between(-100, 2000), between(5000, 25000), 0));
+            for (int i = between(1, 3); i > 0; i--)
+            {
+                int start = between(0, 300);
+                int duration = between(0, 2) ? between(1, 300) : 0;
+                if (between(0, 1)) sprite.AddEventInTrigger(EventType::F, easing(), start, start + duration, between(0, 2) / 2.0, between(0, 2) / 2.0);
+                else sprite.AddEventInTrigger(EventType::C, Easing::None, start, start + duration, Colour(1, 1, 1), Colour(between(0, 9) / 9.0, 1, 0));
+            }
+        }
+        std::vector<std::pair<double, HitSound>> hitSounds;
+        double hitTime = between(-200, 500);
+        for (int i = between(0, 80); i > 0; i--)
+        {
+            hitTime += between(0, 5) ? between(250, 700) : between(1, 300);
+            hitSounds.push_back({ hitTime, HitSound(between(0, 3), between(0, 3), between(0, 15) & 14, between(0, 2)) });
+        }
+        sprite.Initialise(HitSoundIndex(hitSounds));
+
+        SpriteKeyframes before = sprite.GetKeyframes();
+        keyframesBefore += before.Count();
+        sprite.SimplifyKeyframes();
+        const SpriteKeyframes& after = sprite.GetKeyframes();
+        keyframesAfter += after.Count();
+        compareTracks("position x", s, before.position.first, after.position.first);
+        compareTracks("position y", s, before.position.second, after.position.second);
+        compareTracks("rotation", s, before.rotation, after.rotation);
+        compareTracks("scale x", s, before.scale.first, after.scale.first);
+        compareTracks("scale y", s, before.scale.second, after.scale.second);
+        compareTracks("colour", s, before.colour, after.colour);
+        compareTracks("opacity", s, before.opacity, after.opacity);
+        compareTracks("flip v", s, before.flipV, after.flipV);
+        compareTracks("flip h", s, before.flipH, after.flipH);
+        compareTracks("additive", s, before.additive, after.additive);
+    }
+    std::cout << "Simplified " << keyframesBefore << " keyframes to " << keyframesAfter << ", " << samples << " samples, " << failures << " differ\n";
+    return failures == 0 ? 0 : 1;
+}